@@ -0,0 +1,160 @@
+#ifndef MATRIXLIB_CHAIN_PLAN_H
+#define MATRIXLIB_CHAIN_PLAN_H
+
+#include<vector>
+#include<limits>
+#include<cstddef>
+#include<algorithm>
+
+// weight of a byte of temporary storage against a flop in the cost of a plan:
+// a temporary is written once and read back once by the next product
+constexpr double chain_byte_cost = 2.0;
+
+// sub-chains cheaper than this are evaluated one after the other: below it,
+// handing half of the work to another thread costs more than it saves
+constexpr double chain_fork_cost = 1<<20;
+
+// cost of one step of a plan: an a x b by b x c product and its a x c result
+constexpr double chain_step_cost(double a, double b, double c, std::size_t elem_size) {
+    return 2*a*b*c + chain_byte_cost*a*c*elem_size;
+}
+
+// temporaries held at most at once by one step of a plan: its two halves,
+// peaking at lhs and rhs and keeping results of lhs_kept and rhs_kept bytes,
+// run one after the other in the better order, then its own result of out
+// bytes is taken while both halves are still held
+constexpr double chain_step_peak(double lhs, double lhs_kept, double rhs, double rhs_kept, double out) {
+    return std::max(std::min(std::max(lhs, lhs_kept + rhs), std::max(rhs, rhs_kept + lhs)),
+                    lhs_kept + rhs_kept + out);
+}
+
+// optimal evaluation order of a product chain M_0 * ... * M_{n-1}, M_i being
+// dims[i] x dims[i+1]. The classic O(n^3) dynamic programme over sub-chains,
+// where one product of an a x b by a b x c matrix costs 2abc flops plus
+// its a x c result. Factors with equal ids are the same matrix: a split into
+// two identical halves pays for one of them only, since it is computed once.
+// With a limit, in bytes, a sub-chain is split where its temporaries peak
+// within it if any split does, where they peak lowest otherwise. The result
+// of the whole chain goes to its destination and is no temporary.
+class chain_plan {
+public:
+    chain_plan(const std::vector<unsigned>& dims, std::size_t elem_size,
+               const std::vector<unsigned>& ids = {}, double limit = 0) :
+            n(dims.size()-1), elem_size(elem_size), dims(dims), costs(n*n, 0.0), peaks(n*n, 0.0), splits(n*n, 0) {
+        for (unsigned len=2; len<=n; ++len)
+            for (unsigned i=0; i+len<=n; ++i) {
+                const unsigned j = i+len-1;
+                const double out = len==n ? 0.0 : bytes(i,j);
+                double best = std::numeric_limits<double>::infinity();
+                double lowest = best;
+                bool fits = false;
+                for (unsigned k=i; k!=j; ++k) {
+                    const bool twins = !ids.empty() && k-i+1==j-k
+                                       && std::equal(ids.begin()+i, ids.begin()+k+1, ids.begin()+k+1);
+                    const double cost = costs[i*n+k] + (twins ? 0.0 : costs[(k+1)*n+j])
+                                        + chain_step_cost(dims[i], dims[k+1], dims[j+1], elem_size);
+                    const double held = twins
+                            ? chain_step_peak(peak(i,k), kept(i,k), 0.0, 0.0, out)
+                            : chain_step_peak(peak(i,k), kept(i,k), peak(k+1,j), kept(k+1,j), out);
+                    const bool within = limit==0 || held<=limit;
+                    if (within ? !fits || cost<best : !fits && held<lowest) {
+                        fits = within;
+                        best = cost;
+                        lowest = held;
+                        splits[i*n+j] = k;
+                    }
+                }
+                costs[i*n+j] = best;
+                peaks[i*n+j] = lowest;
+            }
+    }
+
+    // the sub-chain [i, j] is best computed as [i, split] * [split+1, j]
+    unsigned split(unsigned i, unsigned j) const { return splits[i*n+j]; }
+    double cost(unsigned i, unsigned j) const { return costs[i*n+j]; }
+    double cost() const { return cost(0, n-1); }
+    unsigned size() const { return n; }
+
+    // bytes of temporaries held at most at once while computing [i, j]
+    // this way, its own result included unless it is the whole chain, and
+    // the bytes of that result; both 0 for a single factor
+    double peak(unsigned i, unsigned j) const { return peaks[i*n+j]; }
+    double kept(unsigned i, unsigned j) const { return i==j ? 0.0 : bytes(i,j); }
+
+private:
+    double bytes(unsigned i, unsigned j) const { return double(dims[i])*dims[j+1]*elem_size; }
+
+    unsigned n;
+    std::size_t elem_size;
+    std::vector<unsigned> dims;
+    std::vector<double> costs, peaks;
+    std::vector<unsigned> splits;
+};
+
+
+// solved programme of a chain known at compile time, n factors long
+template<unsigned n>
+struct static_chain_table {
+    double costs[n][n];
+    double peaks[n][n];
+    unsigned splits[n][n];
+};
+
+template<std::size_t elem_size, unsigned... dims>
+constexpr static_chain_table<sizeof...(dims)-1> solve_static_chain() {
+    constexpr unsigned n = sizeof...(dims)-1;
+    const unsigned dim[] = {dims...};
+    static_chain_table<n> t{};
+    for (unsigned len=2; len<=n; ++len)
+        for (unsigned i=0; i+len<=n; ++i) {
+            const unsigned j = i+len-1;
+            t.costs[i][j] = std::numeric_limits<double>::infinity();
+            for (unsigned k=i; k!=j; ++k) {
+                const double cost = t.costs[i][k] + t.costs[k+1][j]
+                                    + chain_step_cost(dim[i], dim[k+1], dim[j+1], elem_size);
+                if (cost < t.costs[i][j]) {
+                    t.costs[i][j] = cost;
+                    t.splits[i][j] = k;
+                }
+            }
+            // bytes kept by the two halves, single factors keeping none, and
+            // by the result unless it is that of the whole chain
+            const unsigned k = t.splits[i][j];
+            const double lhs_kept = k==i ? 0.0 : double(dim[i])*dim[k+1]*elem_size;
+            const double rhs_kept = k+1==j ? 0.0 : double(dim[k+1])*dim[j+1]*elem_size;
+            t.peaks[i][j] = chain_step_peak(t.peaks[i][k], lhs_kept, t.peaks[k+1][j], rhs_kept,
+                                            len==n ? 0.0 : double(dim[i])*dim[j+1]*elem_size);
+        }
+    return t;
+}
+
+// the same plan for a chain whose dimensions are all known at compile time:
+// every split is a constant expression, so the evaluation tree is fixed when
+// the product is instantiated. The programme is solved once per chain, into
+// a constant table every query reads from.
+template<std::size_t elem_size, unsigned... dims>
+struct static_chain_plan {
+    static_assert(sizeof...(dims) > 2, "a product chain has at least two factors");
+
+    static constexpr unsigned size() { return sizeof...(dims)-1; }
+
+    static constexpr unsigned dim(unsigned i) {
+        const unsigned d[] = {dims...};
+        return d[i];
+    }
+
+    static constexpr unsigned split(unsigned i, unsigned j) { return solved.splits[i][j]; }
+    static constexpr double cost(unsigned i, unsigned j) { return solved.costs[i][j]; }
+    static constexpr double peak(unsigned i, unsigned j) { return solved.peaks[i][j]; }
+    static constexpr double kept(unsigned i, unsigned j) {
+        return i==j ? 0.0 : double(dim(i))*dim(j+1)*elem_size;
+    }
+
+private:
+    static constexpr static_chain_table<sizeof...(dims)-1> solved = solve_static_chain<elem_size, dims...>();
+};
+
+template<std::size_t elem_size, unsigned... dims>
+constexpr static_chain_table<sizeof...(dims)-1> static_chain_plan<elem_size, dims...>::solved;
+
+#endif //MATRIXLIB_CHAIN_PLAN_H
@@ -0,0 +1,216 @@
+#ifndef MATRIXLIB_GEMM_H
+#define MATRIXLIB_GEMM_H
+
+#include<vector>
+#include<functional>
+#include<algorithm>
+
+#include"matrix_wrap.h"
+#include"kernels.h"
+#include"thread_pool.h"
+
+// cache blocking of the packed product: an mc x kc block of the left operand
+// stays in L2 while a kc x nc panel of the right operand streams through L3.
+// mc and nc are multiples of every micro-kernel tile size.
+constexpr unsigned gemm_mc = 96;
+constexpr unsigned gemm_kc = 256;
+constexpr unsigned gemm_nc = 1536;
+
+
+// an operand of the packed product given by its storage alone, e.g. a
+// sized matrix or a temporary of a sized chain
+template<typename T>
+struct gemm_view {
+    typedef T type;
+
+    raw_view<T> get_raw() const { return view; }
+    unsigned get_height() const { return height; }
+    unsigned get_width() const { return width; }
+    // never asked for: the storage is always addressable
+    std::vector<T> get_sub(unsigned, unsigned, unsigned, unsigned) const { return {}; }
+
+    raw_view<T> view;
+    unsigned height, width;
+};
+
+
+// operand of the packed product: blocks are read straight from the storage
+// when the operand is addressable, otherwise they are fetched with get_sub
+template<typename T, class Source = matrix_wrap<T>>
+class gemm_operand {
+public:
+    gemm_operand(const Source& M) : mat(M), view(M.get_raw()) {}
+
+    raw_view<T> block(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) {
+        if (view.data)
+            return {view.data + from_r*view.row_step + from_c*view.col_step,
+                    view.row_step, view.col_step};
+        scratch = mat.get_sub(from_r, to_r, from_c, to_c);
+        return {scratch.data(), to_c-from_c, 1};
+    }
+
+private:
+    Source mat;
+    raw_view<T> view;
+    std::vector<T> scratch;
+};
+
+
+// packs an mc x kc block into slivers of mr rows, each stored column by column.
+// rows past mc are zero-filled so that the kernel never needs edge cases.
+template<typename R, typename T>
+void pack_block_a(R* dest, raw_view<T> src, unsigned mc, unsigned kc, unsigned mr) {
+    if (src.col_step==1) {
+        for (unsigned i0=0; i0<mc; i0+=mr)
+            for (unsigned p=0; p!=kc; ++p)
+                for (unsigned i=i0; i!=i0+mr; ++i)
+                    *dest++ = i<mc ? R(src.data[i*src.row_step + p]) : R(0);
+        return;
+    }
+    // transposed storage: walk each row of the sliver along its contiguous side
+    for (unsigned i0=0; i0<mc; i0+=mr, dest+=mr*kc)
+        for (unsigned i=i0; i!=i0+mr; ++i) {
+            const T* from = src.data + i*src.row_step;
+            for (unsigned p=0; p!=kc; ++p)
+                dest[p*mr + i-i0] = i<mc ? R(from[p*src.col_step]) : R(0);
+        }
+}
+
+// packs a kc x nc panel into slivers of nr columns, each stored row by row.
+template<typename R, typename T>
+void pack_panel_b(R* dest, raw_view<T> src, unsigned kc, unsigned nc, unsigned nr) {
+    if (src.row_step!=1 || src.col_step==1) {
+        for (unsigned j0=0; j0<nc; j0+=nr)
+            for (unsigned p=0; p!=kc; ++p)
+                for (unsigned j=j0; j!=j0+nr; ++j)
+                    *dest++ = j<nc ? R(src.data[p*src.row_step + j*src.col_step]) : R(0);
+        return;
+    }
+    // transposed storage (e.g. the right operand of A*A.transpose()): each
+    // column of the panel is a contiguous row of the untransposed matrix
+    for (unsigned j0=0; j0<nc; j0+=nr, dest+=nr*kc)
+        for (unsigned j=j0; j!=j0+nr; ++j) {
+            const T* from = src.data + j*src.col_step;
+            for (unsigned p=0; p!=kc; ++p)
+                dest[p*nr + j-j0] = j<nc ? R(from[p]) : R(0);
+        }
+}
+
+inline unsigned round_up(unsigned x, unsigned step) { return (x+step-1)/step*step; }
+
+
+// packed copy of the columns [from_c, from_c+nc) of the right operand,
+// one kc x nc panel after the other
+template<typename R>
+class gemm_packed_panel {
+public:
+    template<class Source>
+    gemm_packed_panel(const Source& rhs, unsigned from_c, unsigned nc, const gemm_kernel<R>& kern) :
+            width(nc), padded(round_up(nc, kern.nr)),
+            packed(std::size_t(rhs.get_height())*padded) {
+        gemm_operand<typename Source::type, Source> src(rhs);
+        const unsigned k = rhs.get_height();
+        for (unsigned pc=0; pc<k; pc+=gemm_kc) {
+            const unsigned kc = std::min(gemm_kc, k-pc);
+            pack_panel_b(sliver(pc), src.block(pc, pc+kc, from_c, from_c+nc), kc, nc, kern.nr);
+        }
+    }
+
+    const R* sliver(unsigned pc) const { return packed.data() + std::size_t(pc)*padded; }
+    R* sliver(unsigned pc) { return packed.data() + std::size_t(pc)*padded; }
+    unsigned get_width() const { return width; }
+
+private:
+    unsigned width, padded;
+    std::vector<R> packed;
+};
+
+
+// computes the rows [from_r, from_r+mc) of the product of lhs with a packed
+// panel of the right operand, writing them to c (already offset to the
+// first column of the panel). When upper is set only the tiles reaching the
+// upper triangle are computed, first_col being the column of the panel.
+template<typename R, class Source>
+void gemm_block(raw_view<R> c, const Source& lhs, const gemm_packed_panel<R>& panel,
+                unsigned from_r, unsigned mc, const gemm_kernel<R>& kern,
+                bool upper=false, unsigned first_col=0) {
+    gemm_operand<typename Source::type, Source> src(lhs);
+    const unsigned k = lhs.get_width();
+    const unsigned nc = panel.get_width();
+    std::vector<R> packed(std::size_t(round_up(mc, kern.mr))*std::min(gemm_kc, k));
+    for (unsigned pc=0; pc<k; pc+=gemm_kc) {
+        const unsigned kc = std::min(gemm_kc, k-pc);
+        pack_block_a(packed.data(), src.block(from_r, from_r+mc, pc, pc+kc), mc, kc, kern.mr);
+        const R* b = panel.sliver(pc);
+        for (unsigned jr=0; jr<nc; jr+=kern.nr, b+=kern.nr*kc) {
+            const R* a = packed.data();
+            R* dest = c.data + from_r*c.row_step + jr;
+            for (unsigned ir=0; ir<mc; ir+=kern.mr, a+=kern.mr*kc, dest+=kern.mr*c.row_step) {
+                if (upper && from_r+ir >= first_col+jr+kern.nr) break;
+                kern.kernel(kc, a, b, dest, c.row_step,
+                            std::min(kern.mr, mc-ir), std::min(kern.nr, nc-jr), pc!=0);
+            }
+        }
+    }
+}
+
+// true when rhs is lhs.transpose() over the same storage, so that the
+// product is square and symmetric (X * X.transpose()). Both sides must be
+// the same view: a window of X starting at the same place is not.
+template<class L, class Rhs>
+bool gemm_is_gram(const L&, const Rhs&) { return false; }
+
+template<class Source>
+bool gemm_is_gram(const Source& lhs, const Source& rhs) {
+    const auto a = lhs.get_raw(), b = rhs.get_raw();
+    return a.data && a.data==b.data && a.row_step==b.col_step && a.col_step==b.row_step
+           && lhs.get_height()==rhs.get_width() && lhs.get_width()==rhs.get_height();
+}
+
+// copies the upper triangle of the n x n matrix c onto the lower one,
+// block by block so that both sides stay in cache
+template<typename R>
+void mirror_upper(raw_view<R> c, unsigned n) {
+    constexpr unsigned tile = 64;
+    for (unsigned i0=0; i0<n; i0+=tile)
+        for (unsigned j0=0; j0<=i0; j0+=tile)
+            for (unsigned i=i0; i!=std::min(i0+tile, n); ++i)
+                for (unsigned j=j0; j!=std::min(j0+tile, i); ++j)
+                    c.data[i*c.row_step + j] = c.data[j*c.row_step + i];
+}
+
+// c = lhs*rhs, c being a height x width row-major result: the right operand is
+// packed once per column panel, whose row blocks are then computed by the pool.
+// Gram products only compute the upper triangle and mirror it.
+template<typename R, class L, class Rhs>
+void gemm_multiply(raw_view<R> c, unsigned height, unsigned width, const L& lhs, const Rhs& rhs) {
+    if(lhs.get_width()==0) {
+        // no term to store: c may not be initialised
+        for(unsigned i=0; i!=height; ++i) std::fill(c.data + i*c.row_step, c.data + i*c.row_step + width, R(0));
+        return;
+    }
+    const gemm_kernel<R>& kern = select_gemm_kernel<R>();
+    const bool upper = gemm_is_gram(lhs, rhs);
+    task_group tiles;
+    for(unsigned j=0; j<width; j=j+gemm_nc) {
+        const unsigned nc = std::min(gemm_nc, width-j);
+        const gemm_packed_panel<R> panel(rhs, j, nc, kern);
+        const raw_view<R> c_panel = {c.data + j, c.row_step, 1};
+        const unsigned rows = upper ? std::min(height, j+nc) : height;
+        if(rows <= gemm_mc) {
+            gemm_block(c_panel, lhs, panel, 0, rows, kern, upper, j);
+            continue;
+        }
+        for(unsigned i=0; i<rows; i=i+gemm_mc) {
+            // block C_{i, i+gemm_mc, j, j+gemm_nc}
+            const unsigned mc = std::min(gemm_mc, rows-i);
+            tiles.run([&, c_panel, i, mc, j] {
+                gemm_block(c_panel, lhs, panel, i, mc, kern, upper, j);
+            });
+        }
+        tiles.wait();
+    }
+    if(upper) mirror_upper(c, height);
+}
+
+#endif //MATRIXLIB_GEMM_H
@@ -0,0 +1,88 @@
+#ifndef MATRIXLIB_HUGE_PAGES_H
+#define MATRIXLIB_HUGE_PAGES_H
+
+// Large blocks mapped on 2MB boundaries and marked for transparent huge
+// pages. A column walk or a B panel of a big product touches a new 4KB page
+// every few elements, and overflows the TLB long before the caches; on 2MB
+// pages the same walk stays within a few entries.
+// Blocks of at least MATRIXLIB_HUGE_PAGE_BYTES (4MB if unset, 0 turns it
+// off) get them. Elsewhere than on Linux every block comes from operator new.
+
+#if defined(__linux__)
+#include<sys/mman.h>
+#define MATRIXLIB_HUGE_PAGES 1
+#else
+#define MATRIXLIB_HUGE_PAGES 0
+#endif
+
+#include<new>
+#include<cstdint>
+#include<cstdlib>
+#include<cstddef>
+
+constexpr std::size_t huge_page_size = std::size_t(2) << 20;
+
+inline std::size_t huge_page_threshold() {
+    static const std::size_t threshold = [] {
+        if (const char* env = std::getenv("MATRIXLIB_HUGE_PAGE_BYTES"))
+            return std::size_t(std::strtoull(env, nullptr, 10));
+        return std::size_t(4) << 20;
+    }();
+    return threshold;
+}
+
+// true when a block of this size is mapped by allocate_huge
+inline bool use_huge_pages(std::size_t bytes) {
+    return MATRIXLIB_HUGE_PAGES && huge_page_threshold()!=0 && bytes >= huge_page_threshold();
+}
+
+// a block of whole 2MB pages, starting on one, zeroed by the system.
+// mmap gives no such alignment: one page more is mapped, and the unaligned
+// head and tail are unmapped again
+inline void* allocate_huge(std::size_t bytes) {
+#if MATRIXLIB_HUGE_PAGES
+    const std::size_t size = (bytes + huge_page_size-1) / huge_page_size * huge_page_size;
+    void* map = ::mmap(nullptr, size + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) throw std::bad_alloc();
+    char* const first = static_cast<char*>(map);
+    const std::uintptr_t at = reinterpret_cast<std::uintptr_t>(first);
+    char* const block = first + ((at + huge_page_size-1) / huge_page_size * huge_page_size - at);
+    if (block != first) ::munmap(first, block - first);
+    if (block + size != first + size + huge_page_size)
+        ::munmap(block + size, first + size + huge_page_size - (block + size));
+    // no huge pages in this kernel only costs the TLB misses again
+    ::madvise(block, size, MADV_HUGEPAGE);
+    return block;
+#else
+    return ::operator new(bytes);
+#endif
+}
+
+inline void deallocate_huge(void* block, std::size_t bytes) {
+#if MATRIXLIB_HUGE_PAGES
+    ::munmap(block, (bytes + huge_page_size-1) / huge_page_size * huge_page_size);
+#else
+    ::operator delete(block);
+#endif
+}
+
+
+// allocator of huge-page blocks, for the storage of large matrices
+template<typename U>
+struct huge_page_allocator {
+    typedef U value_type;
+
+    huge_page_allocator() {}
+    template<typename V>
+    huge_page_allocator(const huge_page_allocator<V>&) {}
+
+    U* allocate(std::size_t n) { return static_cast<U*>(allocate_huge(n*sizeof(U))); }
+    void deallocate(U* p, std::size_t n) { deallocate_huge(p, n*sizeof(U)); }
+
+    template<typename V>
+    bool operator ==(const huge_page_allocator<V>&) const { return true; }
+    template<typename V>
+    bool operator !=(const huge_page_allocator<V>&) const { return false; }
+};
+
+#endif //MATRIXLIB_HUGE_PAGES_H
@@ -0,0 +1,138 @@
+#ifndef MATRIXLIB_INCREMENTAL_PRODUCT_H
+#define MATRIXLIB_INCREMENTAL_PRODUCT_H
+
+#include<vector>
+#include<algorithm>
+
+#include"matrix.h"
+#include"matrix_wrap.h"
+#include"kernels.h"
+#include"operations.h"
+
+// share of changed operand rows above which the product is recomputed whole:
+// the corrections run through the same packed kernel, so past this point they
+// only add the cost of gathering rows
+constexpr double incremental_rebuild_share = 0.5;
+
+
+// product A*B kept up to date with its operands. Each get() finds the rows
+// of A and B written since the previous one, by their storage versions and a
+// comparison with a copy of the operands as last seen, and corrects only
+// those: a changed row of A gives a row of the product to recompute, and the
+// changed rows K of B the rank-|K| correction A[:,K] * (B[K,:] - B_seen[K,:]).
+// k changed rows out of n cost O(k n^2) instead of O(n^3).
+template<typename T>
+class incremental_product {
+public:
+    template<class LType, class RType>
+    incremental_product(const matrix_ref<T,LType>& A, const matrix_ref<T,RType>& B) :
+            lhs(A), rhs(B), lhs_seen(A.get_height(), A.get_width()), rhs_seen(B.get_height(), B.get_width()),
+            result(A.get_height(), B.get_width()) {
+        if (A.get_width()!=B.get_height())
+            throw std::domain_error("dimension mismatch in Matrix multiplication");
+        rebuild();
+    }
+
+    // the product of the operands as they are now
+    const matrix<T>& get() {
+        const bool lhs_changed = changed(lhs, lhs_version);
+        const bool rhs_changed = changed(rhs, rhs_version);
+        if (!lhs_changed && !rhs_changed) return result;
+        const std::vector<unsigned> rows = lhs_changed ? changed_rows(lhs, lhs_seen) : std::vector<unsigned>();
+        const std::vector<unsigned> inner = rhs_changed ? changed_rows(rhs, rhs_seen) : std::vector<unsigned>();
+        if (rows.size() + inner.size() > incremental_rebuild_share*(lhs.get_height() + rhs.get_height())) {
+            rebuild();
+            return result;
+        }
+        writable();
+        if (!inner.empty()) correct_inner(inner);
+        if (!rows.empty()) recompute_rows(rows);
+        copy_rows(lhs_seen, lhs, rows);
+        copy_rows(rhs_seen, rhs, inner);
+        return result;
+    }
+
+private:
+    // false when the operand has a version and it did not move since the last call
+    static bool changed(const matrix_wrap<T>& M, unsigned long& version) {
+        const std::shared_ptr<matrix_buffer<T>> buffer = M.get_buffer();
+        if (!buffer) return true;
+        const unsigned long now = buffer->get_version();
+        const bool moved = now != version;
+        version = now;
+        return moved;
+    }
+
+    static bool same_row(const matrix_wrap<T>& M, const matrix<T>& seen, unsigned i) {
+        const raw_view<T> v = M.get_raw();
+        const unsigned n = M.get_width();
+        auto old = seen.row_begin(i);
+        if (v.data && v.col_step==1) return std::equal(old, old+n, v.data + i*v.row_step);
+        for (unsigned j=0; j!=n; ++j, ++old)
+            if (*old != M(i,j)) return false;
+        return true;
+    }
+
+    static std::vector<unsigned> changed_rows(const matrix_wrap<T>& M, const matrix<T>& seen) {
+        std::vector<unsigned> rows;
+        for (unsigned i=0; i!=M.get_height(); ++i)
+            if (!same_row(M, seen, i)) rows.push_back(i);
+        return rows;
+    }
+
+    static void copy_rows(matrix<T>& seen, const matrix_wrap<T>& M, const std::vector<unsigned>& rows) {
+        for (unsigned i : rows)
+            for (unsigned j=0; j!=M.get_width(); ++j) seen(i,j) = M(i,j);
+    }
+
+    // the result is about to be written through its raw view: its version
+    // moves, and copies taken by callers keep the product they were given
+    void writable() { prepare_write(result); }
+
+    void rebuild() {
+        writable();
+        do_parallel_multiply<T,T>(result, lhs, rhs);
+        do_sum<T>(lhs_seen, {lhs});
+        do_sum<T>(rhs_seen, {rhs});
+        changed(lhs, lhs_version);
+        changed(rhs, rhs_version);
+    }
+
+    // rows of the result = the same rows of A, times B. The operands are
+    // only read, through const access: a mutable one would mark them written
+    void recompute_rows(const std::vector<unsigned>& rows) {
+        const matrix_wrap<T>& A = lhs;
+        const unsigned span = A.get_width(), width = rhs.get_width();
+        matrix<T> a(rows.size(), span, pool_allocator<char>(), matrix_init::uninitialized), c(rows.size(), width, pool_allocator<char>(), matrix_init::uninitialized);
+        for (unsigned r=0; r!=rows.size(); ++r)
+            for (unsigned k=0; k!=span; ++k) a(r,k) = A(rows[r],k);
+        do_parallel_multiply<T,T>(c, a, rhs);
+        for (unsigned r=0; r!=rows.size(); ++r)
+            std::copy(c.row_begin(r), c.row_end(r), result.row_begin(rows[r]));
+    }
+
+    // result += A[:,K] * (B[K,:] - B_seen[K,:])
+    void correct_inner(const std::vector<unsigned>& inner) {
+        const matrix_wrap<T>& A = lhs;
+        const matrix_wrap<T>& B = rhs;
+        const matrix<T>& B_seen = rhs_seen;
+        const unsigned height = A.get_height(), width = B.get_width();
+        matrix<T> a(height, inner.size(), pool_allocator<char>(), matrix_init::uninitialized), delta(inner.size(), width, pool_allocator<char>(), matrix_init::uninitialized),
+                c(height, width, pool_allocator<char>(), matrix_init::uninitialized);
+        for (unsigned i=0; i!=height; ++i)
+            for (unsigned r=0; r!=inner.size(); ++r) a(i,r) = A(i,inner[r]);
+        for (unsigned r=0; r!=inner.size(); ++r)
+            for (unsigned j=0; j!=width; ++j) delta(r,j) = B(inner[r],j) - B_seen(inner[r],j);
+        do_parallel_multiply<T,T>(c, a, delta);
+        const add_kernel<T> add = select_add_kernel<T>();
+        for (unsigned i=0; i!=height; ++i)
+            add(&*result.row_begin(i), &*result.row_begin(i), &*c.row_begin(i), width);
+    }
+
+    matrix_wrap<T> lhs, rhs;
+    matrix<T> lhs_seen, rhs_seen;
+    matrix<T> result;
+    unsigned long lhs_version = 0, rhs_version = 0;
+};
+
+#endif //MATRIXLIB_INCREMENTAL_PRODUCT_H
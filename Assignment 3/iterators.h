@@ -1,9 +1,123 @@
 #ifndef _MATRIX_ITERATORS_H_
 #define _MATRIX_ITERATORS_H_
 
+#include<iterator>
+#include<cstddef>
+#include<type_traits>
+
 #include"matrix_fwd.h"
 
 
+// walks rows stored stride elements apart one after the other, skipping
+// the padding at the end of each. Random access: a position is its row, found
+// from the start of the row it points into, and its column
+template<typename T>
+class strided_iterator {
+	T* pos;
+	unsigned col, width, gap;
+	
+	template<typename U> friend class strided_iterator;
+	
+	public:
+	
+	typedef std::random_access_iterator_tag iterator_category;
+	typedef typename std::remove_const<T>::type value_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef T* pointer;
+	typedef T& reference;
+	
+	strided_iterator& operator ++() {
+		++pos;
+		if (++col==width) {
+			col=0;
+			pos+=gap;
+		}
+		return *this;
+	}
+	strided_iterator operator ++(int) {
+		strided_iterator old=*this;
+		operator++();
+		return old;
+	}
+	strided_iterator& operator --() {
+		if (col==0) {
+			col=width;
+			pos-=gap;
+		}
+		--col;
+		--pos;
+		return *this;
+	}
+	strided_iterator operator --(int) {
+		strided_iterator old=*this;
+		operator--();
+		return old;
+	}
+	
+	// n steps forward, or back when negative. A matrix without columns has
+	// no elements: its only position is begin, which is also end
+	strided_iterator& operator +=(difference_type n) {
+		if (width==0) return *this;
+		const difference_type w = width, to = difference_type(col) + n;
+		difference_type rows = to/w, c = to%w;
+		if (c<0) {
+			c+=w;
+			--rows;
+		}
+		pos += rows*(w+gap) + c - difference_type(col);
+		col = unsigned(c);
+		return *this;
+	}
+	strided_iterator& operator -=(difference_type n) { return operator+=(-n); }
+	strided_iterator operator +(difference_type n) const {
+		strided_iterator X=*this;
+		return X+=n;
+	}
+	strided_iterator operator -(difference_type n) const {
+		strided_iterator X=*this;
+		return X+=-n;
+	}
+	friend strided_iterator operator +(difference_type n, const strided_iterator& X) {
+		return X+n;
+	}
+	
+	difference_type operator -(const strided_iterator& X) const {
+		if (width==0) return 0;
+		const difference_type rows = ((pos-col) - (X.pos-X.col)) / difference_type(width+gap);
+		return rows*difference_type(width) + difference_type(col) - difference_type(X.col);
+	}
+	
+	T& operator *() const {
+		return *pos;
+	}
+	T* operator ->() const {
+		return pos;
+	}
+	T& operator [](difference_type n) const {
+		return *(*this+n);
+	}
+	
+	bool operator == (const strided_iterator& X) const {
+		return pos==X.pos;
+	}
+	bool operator != (const strided_iterator& X) const {
+		return ! operator==(X);
+	}
+	bool operator < (const strided_iterator& X) const { return pos<X.pos; }
+	bool operator > (const strided_iterator& X) const { return pos>X.pos; }
+	bool operator <= (const strided_iterator& X) const { return pos<=X.pos; }
+	bool operator >= (const strided_iterator& X) const { return pos>=X.pos; }
+	
+	strided_iterator() : pos(nullptr), col(0), width(1), gap(0) {}
+	strided_iterator(T* row, unsigned width, unsigned stride) : 
+			pos(row), col(0), width(width), gap(stride-width) {}
+	template<typename U>
+	strided_iterator(const strided_iterator<U>& X) : 
+			pos(X.pos), col(X.col), width(X.width), gap(X.gap) {}
+};
+
+
+
 template<typename T, class matrix_type>
 class index_col_iterator {
 	matrix_ref<T, matrix_type>& ref;
@@ -0,0 +1,364 @@
+#ifndef MATRIXLIB_KERNELS_H
+#define MATRIXLIB_KERNELS_H
+
+// Inner kernels of products and additions. Every kernel exists in a portable
+// version and, on x86, in SSE4.2, AVX2 and AVX-512 versions compiled with
+// function-level target attributes, so one binary carries all of them.
+// The variant is chosen once, from CPUID, the first time a kernel is needed.
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MATRIXLIB_X86_SIMD 1
+#include<immintrin.h>
+#else
+#define MATRIXLIB_X86_SIMD 0
+#endif
+
+
+enum class simd_level { generic, sse42, avx2, avx512 };
+
+inline simd_level detect_simd_level() {
+#if MATRIXLIB_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return simd_level::avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return simd_level::avx2;
+    if (__builtin_cpu_supports("sse4.2")) return simd_level::sse42;
+#endif
+    return simd_level::generic;
+}
+
+inline simd_level host_simd_level() {
+    static const simd_level level = detect_simd_level();
+    return level;
+}
+
+
+// a micro-kernel multiplies an mr x kc packed sliver of the left operand by a
+// kc x nr packed sliver of the right operand, keeping the mr x nr accumulators
+// in registers, and writes (or adds, if accumulate) the top-left m x n corner
+// of the tile to c, whose rows are ldc elements apart.
+template<typename T>
+struct gemm_kernel {
+    typedef void (*kernel_type)(unsigned kc, const T* a, const T* b, T* c, unsigned ldc,
+                                unsigned m, unsigned n, bool accumulate);
+    unsigned mr, nr;
+    kernel_type kernel;
+};
+
+// dest[i] = a[i] + b[i] (or a[i] - b[i]) for i in [0,n); dest may alias a or b
+template<typename T>
+using add_kernel = void (*)(T* dest, const T* a, const T* b, unsigned n);
+
+
+template<typename T, unsigned MR, unsigned NR>
+void generic_micro_kernel(unsigned kc, const T* a, const T* b, T* c, unsigned ldc,
+                          unsigned m, unsigned n, bool accumulate) {
+    T acc[MR][NR] = {};
+    for (unsigned p=0; p!=kc; ++p, a+=MR, b+=NR)
+        for (unsigned i=0; i!=MR; ++i)
+            for (unsigned j=0; j!=NR; ++j)
+                acc[i][j] += a[i]*b[j];
+    for (unsigned i=0; i!=m; ++i, c+=ldc)
+        for (unsigned j=0; j!=n; ++j)
+            c[j] = accumulate ? c[j]+acc[i][j] : acc[i][j];
+}
+
+template<typename T>
+void generic_add_kernel(T* dest, const T* a, const T* b, unsigned n) {
+    for (unsigned i=0; i!=n; ++i)
+        dest[i] = a[i] + b[i];
+}
+
+template<typename T>
+void generic_sub_kernel(T* dest, const T* a, const T* b, unsigned n) {
+    for (unsigned i=0; i!=n; ++i)
+        dest[i] = a[i] - b[i];
+}
+
+
+#if MATRIXLIB_X86_SIMD
+
+#define MATRIXLIB_SSE42 __attribute__((target("sse4.2")))
+#define MATRIXLIB_AVX2 __attribute__((target("avx2,fma")))
+#define MATRIXLIB_AVX512 __attribute__((target("avx512f")))
+
+// one register type and the handful of operations the kernels need,
+// for every (instruction set, element type) pair
+
+struct sse42_float {
+    typedef float type;
+    typedef __m128 reg;
+    static constexpr unsigned lanes = 4;
+    MATRIXLIB_SSE42 static reg zero() { return _mm_setzero_ps(); }
+    MATRIXLIB_SSE42 static reg set1(float x) { return _mm_set1_ps(x); }
+    MATRIXLIB_SSE42 static reg load(const float* p) { return _mm_loadu_ps(p); }
+    MATRIXLIB_SSE42 static void store(float* p, reg x) { _mm_storeu_ps(p, x); }
+    MATRIXLIB_SSE42 static reg add(reg x, reg y) { return _mm_add_ps(x, y); }
+    MATRIXLIB_SSE42 static reg sub(reg x, reg y) { return _mm_sub_ps(x, y); }
+    MATRIXLIB_SSE42 static reg madd(reg x, reg y, reg z) { return _mm_add_ps(_mm_mul_ps(x, y), z); }
+};
+
+struct sse42_double {
+    typedef double type;
+    typedef __m128d reg;
+    static constexpr unsigned lanes = 2;
+    MATRIXLIB_SSE42 static reg zero() { return _mm_setzero_pd(); }
+    MATRIXLIB_SSE42 static reg set1(double x) { return _mm_set1_pd(x); }
+    MATRIXLIB_SSE42 static reg load(const double* p) { return _mm_loadu_pd(p); }
+    MATRIXLIB_SSE42 static void store(double* p, reg x) { _mm_storeu_pd(p, x); }
+    MATRIXLIB_SSE42 static reg add(reg x, reg y) { return _mm_add_pd(x, y); }
+    MATRIXLIB_SSE42 static reg sub(reg x, reg y) { return _mm_sub_pd(x, y); }
+    MATRIXLIB_SSE42 static reg madd(reg x, reg y, reg z) { return _mm_add_pd(_mm_mul_pd(x, y), z); }
+};
+
+struct sse42_int {
+    typedef int type;
+    typedef __m128i reg;
+    static constexpr unsigned lanes = 4;
+    MATRIXLIB_SSE42 static reg zero() { return _mm_setzero_si128(); }
+    MATRIXLIB_SSE42 static reg set1(int x) { return _mm_set1_epi32(x); }
+    MATRIXLIB_SSE42 static reg load(const int* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    MATRIXLIB_SSE42 static void store(int* p, reg x) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), x); }
+    MATRIXLIB_SSE42 static reg add(reg x, reg y) { return _mm_add_epi32(x, y); }
+    MATRIXLIB_SSE42 static reg sub(reg x, reg y) { return _mm_sub_epi32(x, y); }
+    MATRIXLIB_SSE42 static reg madd(reg x, reg y, reg z) { return _mm_add_epi32(_mm_mullo_epi32(x, y), z); }
+};
+
+struct avx2_float {
+    typedef float type;
+    typedef __m256 reg;
+    static constexpr unsigned lanes = 8;
+    MATRIXLIB_AVX2 static reg zero() { return _mm256_setzero_ps(); }
+    MATRIXLIB_AVX2 static reg set1(float x) { return _mm256_set1_ps(x); }
+    MATRIXLIB_AVX2 static reg load(const float* p) { return _mm256_loadu_ps(p); }
+    MATRIXLIB_AVX2 static void store(float* p, reg x) { _mm256_storeu_ps(p, x); }
+    MATRIXLIB_AVX2 static reg add(reg x, reg y) { return _mm256_add_ps(x, y); }
+    MATRIXLIB_AVX2 static reg sub(reg x, reg y) { return _mm256_sub_ps(x, y); }
+    MATRIXLIB_AVX2 static reg madd(reg x, reg y, reg z) { return _mm256_fmadd_ps(x, y, z); }
+};
+
+struct avx2_double {
+    typedef double type;
+    typedef __m256d reg;
+    static constexpr unsigned lanes = 4;
+    MATRIXLIB_AVX2 static reg zero() { return _mm256_setzero_pd(); }
+    MATRIXLIB_AVX2 static reg set1(double x) { return _mm256_set1_pd(x); }
+    MATRIXLIB_AVX2 static reg load(const double* p) { return _mm256_loadu_pd(p); }
+    MATRIXLIB_AVX2 static void store(double* p, reg x) { _mm256_storeu_pd(p, x); }
+    MATRIXLIB_AVX2 static reg add(reg x, reg y) { return _mm256_add_pd(x, y); }
+    MATRIXLIB_AVX2 static reg sub(reg x, reg y) { return _mm256_sub_pd(x, y); }
+    MATRIXLIB_AVX2 static reg madd(reg x, reg y, reg z) { return _mm256_fmadd_pd(x, y, z); }
+};
+
+struct avx2_int {
+    typedef int type;
+    typedef __m256i reg;
+    static constexpr unsigned lanes = 8;
+    MATRIXLIB_AVX2 static reg zero() { return _mm256_setzero_si256(); }
+    MATRIXLIB_AVX2 static reg set1(int x) { return _mm256_set1_epi32(x); }
+    MATRIXLIB_AVX2 static reg load(const int* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    MATRIXLIB_AVX2 static void store(int* p, reg x) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), x); }
+    MATRIXLIB_AVX2 static reg add(reg x, reg y) { return _mm256_add_epi32(x, y); }
+    MATRIXLIB_AVX2 static reg sub(reg x, reg y) { return _mm256_sub_epi32(x, y); }
+    MATRIXLIB_AVX2 static reg madd(reg x, reg y, reg z) { return _mm256_add_epi32(_mm256_mullo_epi32(x, y), z); }
+};
+
+struct avx512_float {
+    typedef float type;
+    typedef __m512 reg;
+    static constexpr unsigned lanes = 16;
+    MATRIXLIB_AVX512 static reg zero() { return _mm512_setzero_ps(); }
+    MATRIXLIB_AVX512 static reg set1(float x) { return _mm512_set1_ps(x); }
+    MATRIXLIB_AVX512 static reg load(const float* p) { return _mm512_loadu_ps(p); }
+    MATRIXLIB_AVX512 static void store(float* p, reg x) { _mm512_storeu_ps(p, x); }
+    MATRIXLIB_AVX512 static reg add(reg x, reg y) { return _mm512_add_ps(x, y); }
+    MATRIXLIB_AVX512 static reg sub(reg x, reg y) { return _mm512_sub_ps(x, y); }
+    MATRIXLIB_AVX512 static reg madd(reg x, reg y, reg z) { return _mm512_fmadd_ps(x, y, z); }
+};
+
+struct avx512_double {
+    typedef double type;
+    typedef __m512d reg;
+    static constexpr unsigned lanes = 8;
+    MATRIXLIB_AVX512 static reg zero() { return _mm512_setzero_pd(); }
+    MATRIXLIB_AVX512 static reg set1(double x) { return _mm512_set1_pd(x); }
+    MATRIXLIB_AVX512 static reg load(const double* p) { return _mm512_loadu_pd(p); }
+    MATRIXLIB_AVX512 static void store(double* p, reg x) { _mm512_storeu_pd(p, x); }
+    MATRIXLIB_AVX512 static reg add(reg x, reg y) { return _mm512_add_pd(x, y); }
+    MATRIXLIB_AVX512 static reg sub(reg x, reg y) { return _mm512_sub_pd(x, y); }
+    MATRIXLIB_AVX512 static reg madd(reg x, reg y, reg z) { return _mm512_fmadd_pd(x, y, z); }
+};
+
+struct avx512_int {
+    typedef int type;
+    typedef __m512i reg;
+    static constexpr unsigned lanes = 16;
+    MATRIXLIB_AVX512 static reg zero() { return _mm512_setzero_si512(); }
+    MATRIXLIB_AVX512 static reg set1(int x) { return _mm512_set1_epi32(x); }
+    MATRIXLIB_AVX512 static reg load(const int* p) { return _mm512_loadu_si512(p); }
+    MATRIXLIB_AVX512 static void store(int* p, reg x) { _mm512_storeu_si512(p, x); }
+    MATRIXLIB_AVX512 static reg add(reg x, reg y) { return _mm512_add_epi32(x, y); }
+    MATRIXLIB_AVX512 static reg sub(reg x, reg y) { return _mm512_sub_epi32(x, y); }
+    MATRIXLIB_AVX512 static reg madd(reg x, reg y, reg z) { return _mm512_add_epi32(_mm512_mullo_epi32(x, y), z); }
+};
+
+
+// The kernel bodies are the same for every instruction set, only the target
+// attribute changes: they are stamped out once per target by these macros.
+// The micro-kernel keeps MR x NV vector accumulators, NR = NV*lanes columns.
+
+#define MATRIXLIB_SIMD_MICRO_KERNEL(name, target)                                        \
+template<class V, unsigned MR, unsigned NV>                                              \
+target void name(unsigned kc, const typename V::type* a, const typename V::type* b,      \
+                 typename V::type* c, unsigned ldc, unsigned m, unsigned n,              \
+                 bool accumulate) {                                                      \
+    typedef typename V::type T;                                                          \
+    constexpr unsigned NR = NV*V::lanes;                                                 \
+    typename V::reg acc[MR][NV];                                                         \
+    _Pragma("GCC unroll 16")                                                             \
+    for (unsigned i=0; i!=MR; ++i)                                                       \
+        _Pragma("GCC unroll 4")                                                          \
+        for (unsigned j=0; j!=NV; ++j)                                                   \
+            acc[i][j] = V::zero();                                                       \
+    for (unsigned p=0; p!=kc; ++p, a+=MR, b+=NR) {                                       \
+        typename V::reg bv[NV];                                                          \
+        _Pragma("GCC unroll 4")                                                          \
+        for (unsigned j=0; j!=NV; ++j)                                                   \
+            bv[j] = V::load(b + j*V::lanes);                                             \
+        _Pragma("GCC unroll 16")                                                         \
+        for (unsigned i=0; i!=MR; ++i) {                                                 \
+            const typename V::reg av = V::set1(a[i]);                                    \
+            _Pragma("GCC unroll 4")                                                      \
+            for (unsigned j=0; j!=NV; ++j)                                               \
+                acc[i][j] = V::madd(av, bv[j], acc[i][j]);                               \
+        }                                                                                \
+    }                                                                                    \
+    if (m==MR && n==NR) {                                                                \
+        for (unsigned i=0; i!=MR; ++i, c+=ldc)                                           \
+            for (unsigned j=0; j!=NV; ++j)                                               \
+                V::store(c + j*V::lanes, accumulate ?                                    \
+                         V::add(V::load(c + j*V::lanes), acc[i][j]) : acc[i][j]);        \
+        return;                                                                          \
+    }                                                                                    \
+    T tile[MR][NR];                                                                      \
+    for (unsigned i=0; i!=MR; ++i)                                                       \
+        for (unsigned j=0; j!=NV; ++j)                                                   \
+            V::store(&tile[i][j*V::lanes], acc[i][j]);                                   \
+    for (unsigned i=0; i!=m; ++i, c+=ldc)                                                \
+        for (unsigned j=0; j!=n; ++j)                                                    \
+            c[j] = accumulate ? c[j]+tile[i][j] : tile[i][j];                            \
+}
+
+#define MATRIXLIB_SIMD_ADD_KERNEL(name, target, op, sign)                                \
+template<class V>                                                                        \
+target void name(typename V::type* dest, const typename V::type* a,                      \
+                 const typename V::type* b, unsigned n) {                                \
+    unsigned i=0;                                                                        \
+    for (; i+V::lanes<=n; i+=V::lanes)                                                   \
+        V::store(dest+i, V::op(V::load(a+i), V::load(b+i)));                             \
+    for (; i!=n; ++i)                                                                    \
+        dest[i] = a[i] sign b[i];                                                        \
+}
+
+MATRIXLIB_SIMD_MICRO_KERNEL(sse42_micro_kernel, MATRIXLIB_SSE42)
+MATRIXLIB_SIMD_MICRO_KERNEL(avx2_micro_kernel, MATRIXLIB_AVX2)
+MATRIXLIB_SIMD_MICRO_KERNEL(avx512_micro_kernel, MATRIXLIB_AVX512)
+
+MATRIXLIB_SIMD_ADD_KERNEL(sse42_add_kernel, MATRIXLIB_SSE42, add, +)
+MATRIXLIB_SIMD_ADD_KERNEL(avx2_add_kernel, MATRIXLIB_AVX2, add, +)
+MATRIXLIB_SIMD_ADD_KERNEL(avx512_add_kernel, MATRIXLIB_AVX512, add, +)
+MATRIXLIB_SIMD_ADD_KERNEL(sse42_sub_kernel, MATRIXLIB_SSE42, sub, -)
+MATRIXLIB_SIMD_ADD_KERNEL(avx2_sub_kernel, MATRIXLIB_AVX2, sub, -)
+MATRIXLIB_SIMD_ADD_KERNEL(avx512_sub_kernel, MATRIXLIB_AVX512, sub, -)
+
+
+// tile shapes: 8 accumulators for the 16 SSE registers, 12 for the 16 AVX2
+// registers and 24 for the 32 AVX-512 registers
+template<class sse42_ops, class avx2_ops, class avx512_ops>
+gemm_kernel<typename sse42_ops::type> simd_gemm_kernel(simd_level level) {
+    typedef typename sse42_ops::type T;
+    switch (level) {
+        case simd_level::avx512:
+            return {12, 2*avx512_ops::lanes, avx512_micro_kernel<avx512_ops,12,2>};
+        case simd_level::avx2:
+            return {6, 2*avx2_ops::lanes, avx2_micro_kernel<avx2_ops,6,2>};
+        case simd_level::sse42:
+            return {4, 2*sse42_ops::lanes, sse42_micro_kernel<sse42_ops,4,2>};
+        default:
+            return {4, 4, generic_micro_kernel<T,4,4>};
+    }
+}
+
+template<class sse42_ops, class avx2_ops, class avx512_ops>
+add_kernel<typename sse42_ops::type> simd_add_kernel(simd_level level, bool subtract) {
+    typedef typename sse42_ops::type T;
+    switch (level) {
+        case simd_level::avx512:
+            return subtract ? avx512_sub_kernel<avx512_ops> : avx512_add_kernel<avx512_ops>;
+        case simd_level::avx2:
+            return subtract ? avx2_sub_kernel<avx2_ops> : avx2_add_kernel<avx2_ops>;
+        case simd_level::sse42:
+            return subtract ? sse42_sub_kernel<sse42_ops> : sse42_add_kernel<sse42_ops>;
+        default:
+            return subtract ? generic_sub_kernel<T> : generic_add_kernel<T>;
+    }
+}
+
+#endif //MATRIXLIB_X86_SIMD
+
+
+template<typename T>
+gemm_kernel<T> gemm_kernel_for(simd_level) { return {4, 4, generic_micro_kernel<T,4,4>}; }
+
+template<typename T>
+add_kernel<T> add_kernel_for(simd_level, bool subtract=false) {
+    return subtract ? generic_sub_kernel<T> : generic_add_kernel<T>;
+}
+
+#if MATRIXLIB_X86_SIMD
+template<>
+inline gemm_kernel<float> gemm_kernel_for<float>(simd_level level) {
+    return simd_gemm_kernel<sse42_float, avx2_float, avx512_float>(level);
+}
+template<>
+inline gemm_kernel<double> gemm_kernel_for<double>(simd_level level) {
+    return simd_gemm_kernel<sse42_double, avx2_double, avx512_double>(level);
+}
+template<>
+inline gemm_kernel<int> gemm_kernel_for<int>(simd_level level) {
+    return simd_gemm_kernel<sse42_int, avx2_int, avx512_int>(level);
+}
+
+template<>
+inline add_kernel<float> add_kernel_for<float>(simd_level level, bool subtract) {
+    return simd_add_kernel<sse42_float, avx2_float, avx512_float>(level, subtract);
+}
+template<>
+inline add_kernel<double> add_kernel_for<double>(simd_level level, bool subtract) {
+    return simd_add_kernel<sse42_double, avx2_double, avx512_double>(level, subtract);
+}
+template<>
+inline add_kernel<int> add_kernel_for<int>(simd_level level, bool subtract) {
+    return simd_add_kernel<sse42_int, avx2_int, avx512_int>(level, subtract);
+}
+#endif //MATRIXLIB_X86_SIMD
+
+
+template<typename T>
+const gemm_kernel<T>& select_gemm_kernel() {
+    static const gemm_kernel<T> kernel = gemm_kernel_for<T>(host_simd_level());
+    return kernel;
+}
+
+template<typename T>
+add_kernel<T> select_add_kernel() {
+    static const add_kernel<T> kernel = add_kernel_for<T>(host_simd_level());
+    return kernel;
+}
+
+template<typename T>
+add_kernel<T> select_sub_kernel() {
+    static const add_kernel<T> kernel = add_kernel_for<T>(host_simd_level(), true);
+    return kernel;
+}
+
+#endif //MATRIXLIB_KERNELS_H
@@ -6,11 +6,10 @@
 #include<cassert>
 
 #include"matrix_fwd.h"
+#include"matrix_buffer.h"
 #include"iterators.h"
 
 
-
-
 template<typename T> 
 class matrix_ref<T, Plain> {
 	public:
@@ -18,10 +17,10 @@ class matrix_ref<T, Plain> {
 	//type members
 	typedef T type;
 	typedef Plain matrix_type;
-	typedef typename std::vector<T>::iterator iterator;
-	typedef typename std::vector<T>::const_iterator const_iterator;
-	typedef typename std::vector<T>::iterator row_iterator;
-	typedef typename std::vector<T>::const_iterator const_row_iterator;
+	typedef strided_iterator<T> iterator;
+	typedef strided_iterator<const T> const_iterator;
+	typedef strided_iterator<T> row_iterator;
+	typedef strided_iterator<const T> const_row_iterator;
 	
 	typedef index_col_iterator<T,Plain> col_iterator;
 	typedef const_index_col_iterator<T,Plain> const_col_iterator;
@@ -33,20 +32,24 @@ class matrix_ref<T, Plain> {
 	//matrix_ref<T, Plain>& operator =(const matrix_ref<T, Plain>&) = delete;
 	//matrix_ref<T, Plain>& operator =(matrix_ref<T, Plain>&&) = delete;
 	
+	// a view of the storage of X, following X through its writes
+	matrix_ref(const matrix_ref<T, Plain>& X) = default;
+	matrix_ref<T, Plain>& operator =(const matrix_ref<T, Plain>& X) = default;
+	
 	
 	T& operator ()( unsigned row, unsigned column ) { 
-		return data->operator[](row*width + column);
+		return handle->leak()[row*stride + column];
 	}
 	const T& operator ()( unsigned row, unsigned column ) const { 
-		return data->operator[](row*width + column);
+		return handle->read()[row*stride + column];
 	}
-	std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c){
+	std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) const {
         assert(from_r<to_r && from_c<to_c);
         std::vector<T> subdata((to_r-from_r)*(to_c-from_c));
         int k=0;
         for(int i=from_r; i!=to_r; ++i)
             for(int j=from_c; j!=to_c; ++j){
-                subdata[k] = data->operator[](i*width + j);
+                subdata[k] = handle->read()[i*stride + j];
                 ++k;
             }
         return subdata;
@@ -58,15 +61,15 @@ class matrix_ref<T, Plain> {
 	const T& get() const { return operator()(i,j); }
 	
 	
-	iterator begin() { return data->begin(); }
-	iterator end() { return data->end(); }
-	const_iterator begin() const { return data->begin(); }
-	const_iterator end() const { return data->end(); }
+	iterator begin() { return row_begin(0); }
+	iterator end() { return row_begin(height); }
+	const_iterator begin() const { return row_begin(0); }
+	const_iterator end() const { return row_begin(height); }
 	
-	row_iterator row_begin(unsigned i) { return data->begin() + i*width; }
-	row_iterator row_end(unsigned i) { return data->begin() + (i+1)*width; }
-	const_row_iterator row_begin(unsigned i) const { return data->begin() + i*width; }
-	const_row_iterator row_end(unsigned i) const { return data->begin() + (i+1)*width; }
+	row_iterator row_begin(unsigned i) { return {handle->leak().data() + i*stride, width, stride}; }
+	row_iterator row_end(unsigned i) { return row_begin(i+1); }
+	const_row_iterator row_begin(unsigned i) const { return {handle->read().data() + i*stride, width, stride}; }
+	const_row_iterator row_end(unsigned i) const { return row_begin(i+1); }
 	
 	col_iterator col_begin(unsigned i) { return col_iterator(*this,0,i); }
 	col_iterator col_end(unsigned i) { return col_iterator(*this,0,i+1); }
@@ -92,13 +95,23 @@ class matrix_ref<T, Plain> {
 	
 	unsigned get_height() const { return height; }
 	unsigned get_width() const { return width; }
+	// distance between the starts of two rows in the storage
+	unsigned get_stride() const { return stride; }
+	
+	// once filled through references or iterators, which are no longer
+	// used: copies share the storage again until one of them is written
+	void share() { handle->share(); }
 	
+	template<typename U>
+	friend std::shared_ptr<matrix_buffer<U>> get_buffer(const matrix_ref<U, Plain>&);
+	template<typename U>
+	friend void prepare_write(const matrix_ref<U, Plain>&);
 	
 	protected:
 	matrix_ref(){}
-		
-	std::shared_ptr<std::vector<T>> data;
-	unsigned height, width;
+	
+	std::shared_ptr<matrix_handle<T>> handle;
+	unsigned height, width, stride;
 
 };
 
@@ -112,10 +125,10 @@ class matrix_ref<T, Sized<h,w>> {
 	//type members
 	typedef T type;
 	typedef Sized<h,w> matrix_type;
-	typedef typename std::vector<T>::iterator iterator;
-	typedef typename std::vector<T>::const_iterator const_iterator;
-	typedef typename std::vector<T>::iterator row_iterator;
-	typedef typename std::vector<T>::const_iterator const_row_iterator;
+	typedef strided_iterator<T> iterator;
+	typedef strided_iterator<const T> const_iterator;
+	typedef strided_iterator<T> row_iterator;
+	typedef strided_iterator<const T> const_row_iterator;
 	
 	typedef index_col_iterator<T,Sized<h,w>> col_iterator;
 	typedef const_index_col_iterator<T,Sized<h,w>> const_col_iterator;
@@ -127,20 +140,24 @@ class matrix_ref<T, Sized<h,w>> {
 	//matrix_ref<T, Plain>& operator =(const matrix_ref<T, Plain>&) = delete;
 	//matrix_ref<T, Plain>& operator =(matrix_ref<T, Plain>&&) = delete;
 	
+	// a view of the storage of X, following X through its writes
+	matrix_ref(const matrix_ref<T, Sized<h,w>>& X) = default;
+	matrix_ref<T, Sized<h,w>>& operator =(const matrix_ref<T, Sized<h,w>>& X) = default;
+	
 	
 	T& operator ()( unsigned row, unsigned column ) { 
-		return data->operator[](row*width + column);
+		return handle->leak()[row*stride + column];
 	}
 	const T& operator ()( unsigned row, unsigned column ) const { 
-		return data->operator[](row*width + column);
+		return handle->read()[row*stride + column];
 	}
-    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c){
+    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) const {
         assert(from_r<to_r && from_c<to_c);
         std::vector<T> subdata((to_r-from_r)*(to_c-from_c));
         unsigned k=0;
         for(unsigned i=from_r; i!=to_r; ++i)
             for(unsigned j=from_c; j!=to_c; ++j){
-                subdata[k] = data->operator[](i*width + j);
+                subdata[k] = handle->read()[i*stride + j];
                 ++k;
             }
         return subdata;
@@ -158,15 +175,15 @@ class matrix_ref<T, Sized<h,w>> {
 	}
 	
 	
-	iterator begin() { return data->begin(); }
-	iterator end() { return data->end(); }
-	const_iterator begin() const { return data->begin(); }
-	const_iterator end() const { return data->end(); }
+	iterator begin() { return row_begin(0); }
+	iterator end() { return row_begin(height); }
+	const_iterator begin() const { return row_begin(0); }
+	const_iterator end() const { return row_begin(height); }
 	
-	row_iterator row_begin(unsigned i) { return data->begin() + i*width; }
-	row_iterator row_end(unsigned i) { return data->begin() + (i+1)*width; }
-	const_row_iterator row_begin(unsigned i) const { return data->begin() + i*width; }
-	const_row_iterator row_end(unsigned i) const { return data->begin() + (i+1)*width; }
+	row_iterator row_begin(unsigned i) { return {handle->leak().data() + i*stride, width, stride}; }
+	row_iterator row_end(unsigned i) { return row_begin(i+1); }
+	const_row_iterator row_begin(unsigned i) const { return {handle->read().data() + i*stride, width, stride}; }
+	const_row_iterator row_end(unsigned i) const { return row_begin(i+1); }
 	
 	col_iterator col_begin(unsigned i) { return col_iterator(*this,0,i); }
 	col_iterator col_end(unsigned i) { return col_iterator(*this,0,i+1); }
@@ -192,13 +209,20 @@ class matrix_ref<T, Sized<h,w>> {
 	
 	unsigned get_height() const { return height; }
 	unsigned get_width() const { return width; }
+	unsigned get_stride() const { return stride; }
+	
+	void share() { handle->share(); }
 	
+	template<typename U, unsigned h2, unsigned w2>
+	friend std::shared_ptr<matrix_buffer<U>> get_buffer(const matrix_ref<U, Sized<h2,w2>>&);
+	template<typename U, unsigned h2, unsigned w2>
+	friend void prepare_write(const matrix_ref<U, Sized<h2,w2>>&);
 	
 	protected:
 	matrix_ref(){}
-		
-	std::shared_ptr<std::vector<T>> data;
-	unsigned height, width;
+	
+	std::shared_ptr<matrix_handle<T>> handle;
+	unsigned height, width, stride;
 
 };
 
@@ -235,17 +259,15 @@ class matrix_ref<T, Transpose<decorated>> : private matrix_ref<T, decorated> {
 	const T& operator ()( unsigned row, unsigned column ) const
 	{ return base::operator()(column, row); }
 
-    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) {
+    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) const {
         assert(from_r<to_r && from_c<to_c);
         std::vector<T> subdata((to_r-from_r)*(to_c-from_c));
-        std::vector<T> basedata = base::get_sub(from_c, to_c, from_r, to_r);
-        const unsigned width = to_r-from_r;
-        int k=0;
-        for(int j=0; j!=to_r-from_r; ++j)
-            for(int i=0; i!=to_c-from_c; ++i) {
-                subdata[k] = basedata[i*width + j];
-                ++k;
-            }
+        // read the base in its own layout once instead of fetching its block
+        // and permuting it into a second buffer
+        auto k = subdata.begin();
+        for(unsigned i=from_r; i!=to_r; ++i)
+            for(unsigned j=from_c; j!=to_c; ++j)
+                *k++ = base::operator()(j, i);
         return subdata;
     }
 
@@ -284,6 +306,13 @@ class matrix_ref<T, Transpose<decorated>> : private matrix_ref<T, decorated> {
 	
 	unsigned get_height() const { return base::get_width(); }
 	unsigned get_width() const { return base::get_height(); }
+	
+	template<typename U, class D>
+	friend raw_view<U> get_raw_view(const matrix_ref<U, Transpose<D>>&);
+	template<typename U, class D>
+	friend std::shared_ptr<matrix_buffer<U>> get_buffer(const matrix_ref<U, Transpose<D>>&);
+	template<typename U, class D>
+	friend void prepare_write(const matrix_ref<U, Transpose<D>>&);
 		
 	private:
 	matrix_ref(const base&X) : base(X) {}
@@ -315,7 +344,7 @@ class matrix_ref<T, Window<decorated>> : private matrix_ref<T, decorated> {
 	{ return base::operator()(row+spec.row_start, column+spec.col_start); }
 	const T& operator ()( unsigned row, unsigned column ) const
 	{ return base::operator()(row+spec.row_start, column+spec.col_start); }
-    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) {
+    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) const {
         assert(from_r<to_r && from_c<to_c);
         assert(to_r+spec.row_start <= spec.row_end &&
                to_c+spec.col_start <= spec.col_end);
@@ -365,6 +394,13 @@ class matrix_ref<T, Window<decorated>> : private matrix_ref<T, decorated> {
 	
 	
 		
+	template<typename U, class D>
+	friend raw_view<U> get_raw_view(const matrix_ref<U, Window<D>>&);
+	template<typename U, class D>
+	friend std::shared_ptr<matrix_buffer<U>> get_buffer(const matrix_ref<U, Window<D>>&);
+	template<typename U, class D>
+	friend void prepare_write(const matrix_ref<U, Window<D>>&);
+		
 	private:
 	matrix_ref(const base&X, window_spec win) : base(X), spec(win) {
 			assert(spec.row_end<=base::get_height());
@@ -404,7 +440,7 @@ class matrix_ref<T, Diagonal<decorated>> : private matrix_ref<T, decorated> {
 		assert(column==0);
 		return base::operator()(row,row);
 	}
-    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c=0, unsigned to_c=1) {
+    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c=0, unsigned to_c=1) const {
         assert(from_r<to_r && from_c==0 && to_c==1);
         std::vector<T> subdata((to_r-from_r)*(to_c-from_c));
         unsigned k=0;
@@ -505,7 +541,7 @@ class matrix_ref<T, Diagonal_matrix<decorated>> : private matrix_ref<T, decorate
 		if (row!=column) return zero;
 		else return base::operator()(row,0);
 	}
-    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c){
+    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) const {
         assert(from_r<to_r && from_c<to_c);
         std::vector<T> subdata((to_r-from_r)*(to_c-from_c));
         int k=0;
@@ -586,16 +622,41 @@ class matrix<T> : public matrix_ref<T,Plain> {
 	matrix( unsigned height, unsigned width ) {
 		this->height = height;
 		this->width = width;
-		data = std::make_shared<std::vector<T>>(width*height);
+		this->stride = leading_dimension<T>(width);
+		handle = matrix_handle<T>::create(std::size_t(height)*stride);
+		
+		std::cerr << "matrix constructor\n";
+	}
+	
+	// elements started as init says: internal results that are about to be
+	// overwritten skip the value-initialisation
+	matrix( unsigned height, unsigned width, matrix_init init ) {
+		this->height = height;
+		this->width = width;
+		this->stride = leading_dimension<T>(width);
+		handle = matrix_handle<T>::create(std::size_t(height)*stride, std::allocator<char>(), init);
 		
 		std::cerr << "matrix constructor\n";
 	}
 	
+	// storage from alloc (rebound to char) instead of the default allocator
+	template<class Alloc>
+	matrix( unsigned height, unsigned width, const Alloc& alloc, matrix_init init=matrix_init::value ) {
+		this->height = height;
+		this->width = width;
+		this->stride = leading_dimension<T>(width);
+		handle = matrix_handle<T>::create(std::size_t(height)*stride, alloc, init);
+		
+		std::cerr << "matrix constructor\n";
+	}
+	
+	// shares the storage of X until one of the two is written, unless a
+	// reference into it has been handed out
 	matrix(const matrix<T>& X) {
 		height = X.height;
 		width = X.width;
-		data = std::make_shared<std::vector<T>>(width*height);
-		*data = *(X.data);
+		stride = X.stride;
+		handle = X.handle->copy();
 		
 		std::cerr << "matrix copy constructor\n";
 	}
@@ -603,7 +664,8 @@ class matrix<T> : public matrix_ref<T,Plain> {
 	matrix(matrix<T>&& X) {
 		height = X.height;
 		width = X.width;
-		data = std::move(X.data);
+		stride = X.stride;
+		handle = std::move(X.handle);
 		
 		std::cerr << "matrix move constructor\n";
 	}
@@ -612,10 +674,11 @@ class matrix<T> : public matrix_ref<T,Plain> {
 	matrix(const matrix_ref<T,matrix_type>&X) {
 		height = X.get_height();
 		width = X.get_width();
-		data = std::make_shared<std::vector<T>>(width*height);
+		stride = leading_dimension<T>(width);
+		handle = matrix_handle<T>::create(std::size_t(height)*stride, std::allocator<char>(), matrix_init::uninitialized);
 		auto source=X.row_begin(0);
 		const auto end=X.row_begin(height);
-		auto dest=data->begin();
+		strided_iterator<T> dest(handle->detach().data(), width, stride);
 		while (source!=end) {
 			*dest = *source;
 			++dest;
@@ -631,7 +694,8 @@ class matrix<T> : public matrix_ref<T,Plain> {
 	private:
 	using matrix_ref<T,Plain>::height;
 	using matrix_ref<T,Plain>::width; 
-	using matrix_ref<T,Plain>::data; 
+	using matrix_ref<T,Plain>::stride; 
+	using matrix_ref<T,Plain>::handle; 
 
 };
 
@@ -648,24 +712,48 @@ class matrix<T,h,w> : public matrix_ref<T,Sized<h,w>> {
 	matrix() {
 		this->height = h;
 		this->width = w;
-		data = std::make_shared<std::vector<T>>(w*h);
+		this->stride = leading_dimension<T>(w);
+		handle = matrix_handle<T>::create(std::size_t(h)*stride);
+		
+		std::cerr << "sized matrix constructor\n";
+	}
+	
+	explicit matrix(matrix_init init) {
+		this->height = h;
+		this->width = w;
+		this->stride = leading_dimension<T>(w);
+		handle = matrix_handle<T>::create(std::size_t(h)*stride, std::allocator<char>(), init);
 		
 		std::cerr << "sized matrix constructor\n";
 	}
 	
+	// storage from alloc (rebound to char) instead of the default allocator
+	template<class Alloc>
+	matrix(std::allocator_arg_t, const Alloc& alloc, matrix_init init=matrix_init::value) {
+		this->height = h;
+		this->width = w;
+		this->stride = leading_dimension<T>(w);
+		handle = matrix_handle<T>::create(std::size_t(h)*stride, alloc, init);
+		
+		std::cerr << "sized matrix constructor\n";
+	}
+	
+	// shares the storage of X until one of the two is written, unless a
+	// reference into it has been handed out
 	matrix(const matrix<T,h,w>& X) {
 		height = X.height;
 		width = X.width;
-		data = std::make_shared<std::vector<T>>(width*height);
-		*data = *(X.data);
+		stride = X.stride;
+		handle = X.handle->copy();
 		
 		std::cerr << "sized matrix copy constructor\n";
 	}
 	
-		matrix(matrix<T,h,w>&& X) {
+	matrix(matrix<T,h,w>&& X) {
 		height = X.height;
 		width = X.width;
-		data = std::move(X.data);
+		stride = X.stride;
+		handle = std::move(X.handle);
 		
 		std::cerr << "sized matrix move constructor\n";
 	}
@@ -681,10 +769,11 @@ class matrix<T,h,w> : public matrix_ref<T,Sized<h,w>> {
 		height = X.get_height();
 		width = X.get_width();
 		assert(height==h && width==w);
-		data = std::make_shared<std::vector<T>>(width*height);
+		stride = leading_dimension<T>(w);
+		handle = matrix_handle<T>::create(std::size_t(h)*stride, std::allocator<char>(), matrix_init::uninitialized);
 		auto source=X.row_begin(0);
 		const auto end=X.row_begin(height);
-		auto dest=data->begin();
+		strided_iterator<T> dest(handle->detach().data(), width, stride);
 		while (source!=end) {
 			*dest = *source;
 			++dest;
@@ -701,8 +790,85 @@ class matrix<T,h,w> : public matrix_ref<T,Sized<h,w>> {
 	private:
 	using matrix_ref<T,Sized<h,w>>::height;
 	using matrix_ref<T,Sized<h,w>>::width; 
-	using matrix_ref<T,Sized<h,w>>::data; 
+	using matrix_ref<T,Sized<h,w>>::stride; 
+	using matrix_ref<T,Sized<h,w>>::handle; 
 
 };
 
+
+
+template<typename T, class matrix_type>
+raw_view<T> get_raw_view(const matrix_ref<T,matrix_type>&) { return {nullptr, 0, 0}; }
+
+template<typename T>
+raw_view<T> get_raw_view(const matrix_ref<T,Plain>& X) {
+	return {const_cast<T*>(&*X.begin()), X.get_stride(), 1};
+}
+
+template<typename T, unsigned h, unsigned w>
+raw_view<T> get_raw_view(const matrix_ref<T,Sized<h,w>>& X) {
+	return {const_cast<T*>(&*X.begin()), X.get_stride(), 1};
+}
+
+// a transposed view is its base read with the two strides swapped
+template<typename T, class decorated>
+raw_view<T> get_raw_view(const matrix_ref<T,Transpose<decorated>>& X) {
+	const raw_view<T> base = get_raw_view(static_cast<const matrix_ref<T,decorated>&>(X));
+	return {base.data, base.col_step, base.row_step};
+}
+
+template<typename T, class decorated>
+raw_view<T> get_raw_view(const matrix_ref<T,Window<decorated>>& X) {
+	const raw_view<T> base = get_raw_view(static_cast<const matrix_ref<T,decorated>&>(X));
+	if (!base.data) return base;
+	return {base.data + X.spec.row_start*base.row_step + X.spec.col_start*base.col_step,
+			base.row_step, base.col_step};
+}
+
+
+// the storage a matrix views, when it is the one its raw view addresses;
+// nullptr otherwise
+template<typename T, class matrix_type>
+std::shared_ptr<matrix_buffer<T>> get_buffer(const matrix_ref<T,matrix_type>&) { return nullptr; }
+
+template<typename T>
+std::shared_ptr<matrix_buffer<T>> get_buffer(const matrix_ref<T,Plain>& X) { return X.handle->get_buffer(); }
+
+template<typename T, unsigned h, unsigned w>
+std::shared_ptr<matrix_buffer<T>> get_buffer(const matrix_ref<T,Sized<h,w>>& X) { return X.handle->get_buffer(); }
+
+template<typename T, class decorated>
+std::shared_ptr<matrix_buffer<T>> get_buffer(const matrix_ref<T,Transpose<decorated>>& X) {
+	return get_buffer(static_cast<const matrix_ref<T,decorated>&>(X));
+}
+
+template<typename T, class decorated>
+std::shared_ptr<matrix_buffer<T>> get_buffer(const matrix_ref<T,Window<decorated>>& X) {
+	return get_buffer(static_cast<const matrix_ref<T,decorated>&>(X));
+}
+
+
+
+// readies the storage a matrix views for a write through its raw view: a
+// copy of the matrix still sharing it gets its own first, and the version
+// of the storage moves. Nothing to do for views without storage of their own.
+template<typename T, class matrix_type>
+void prepare_write(const matrix_ref<T,matrix_type>&) {}
+
+template<typename T>
+void prepare_write(const matrix_ref<T,Plain>& X) { X.handle->detach(); }
+
+template<typename T, unsigned h, unsigned w>
+void prepare_write(const matrix_ref<T,Sized<h,w>>& X) { X.handle->detach(); }
+
+template<typename T, class decorated>
+void prepare_write(const matrix_ref<T,Transpose<decorated>>& X) {
+	prepare_write(static_cast<const matrix_ref<T,decorated>&>(X));
+}
+
+template<typename T, class decorated>
+void prepare_write(const matrix_ref<T,Window<decorated>>& X) {
+	prepare_write(static_cast<const matrix_ref<T,decorated>&>(X));
+}
+
 #endif //_MATRIX_H_
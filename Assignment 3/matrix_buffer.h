@@ -0,0 +1,305 @@
+#ifndef _MATRIX_BUFFER_H_
+#define _MATRIX_BUFFER_H_
+
+#include<memory>
+#include<atomic>
+#include<algorithm>
+#include<cassert>
+#include<cstddef>
+#include<cstdint>
+#include<cstdlib>
+#include<new>
+#include<type_traits>
+#include<utility>
+
+#include"huge_pages.h"
+
+
+// bytes in a cache line, and in the span of addresses after which a row
+// maps back onto the same sets of a typical 8-way 32KB L1
+constexpr std::size_t cache_line = 64;
+constexpr std::size_t set_alias_span = 512;
+
+// distance in elements between the starts of two rows of a matrix width
+// elements wide. Rows are packed, except when their size is a multiple of
+// set_alias_span: then walking a column would keep hitting the same few
+// cache sets, and each row is padded by one cache line.
+template<typename T>
+constexpr unsigned leading_dimension(unsigned width) {
+	return width!=0 && width*sizeof(T) % set_alias_span == 0
+			? width + unsigned(cache_line>sizeof(T) ? cache_line/sizeof(T) : 1)
+			: width;
+}
+
+
+// returns a buffer, and the block its elements follow it in, to the
+// allocator it came from
+template<class Buffer, class Alloc>
+struct block_deleter {
+	typedef typename std::allocator_traits<Alloc>::template rebind_alloc<char> base_allocator;
+
+	void operator ()(Buffer* p) {
+		p->~Buffer();
+		std::allocator_traits<base_allocator>::deallocate(base, reinterpret_cast<char*>(p), bytes);
+	}
+
+	base_allocator base;
+	std::size_t bytes;
+};
+
+
+// allocator of blocks already zeroed by calloc: large ones are fresh pages
+// the system zeroed, and nothing is written to them here
+template<typename U>
+struct zeroed_allocator {
+	typedef U value_type;
+
+	zeroed_allocator() {}
+	template<typename V>
+	zeroed_allocator(const zeroed_allocator<V>&) {}
+
+	U* allocate(std::size_t n) {
+		if (void* p = std::calloc(n, sizeof(U))) return static_cast<U*>(p);
+		throw std::bad_alloc();
+	}
+	void deallocate(U* p, std::size_t) { std::free(p); }
+
+	template<typename V>
+	bool operator ==(const zeroed_allocator<V>&) const { return true; }
+	template<typename V>
+	bool operator !=(const zeroed_allocator<V>&) const { return false; }
+};
+
+
+// how the elements of a new matrix start: value-initialised, left as they
+// are for results about to be overwritten (types with a trivial default
+// constructor only), or zero for accumulators
+enum class matrix_init { value, uninitialized, zeroed };
+
+
+// storage of a matrix, held by the handles of the matrix and its copies. The elements
+// start on a cache line boundary and live in the same block as the buffer;
+// the allocator behind it is chosen at creation and erased by the shared_ptr,
+// whose reference count is a small block of its own.
+// Any mutable access marks it dirty; the version is bumped the next time it
+// is read, so results computed from an older version can be recognised as
+// stale. Copies of a matrix share its buffer until one of them writes; the
+// buffer counts their handles as owners. Once a reference into it has been
+// handed out it is no longer shareable, and copies get buffers of their own,
+// until the matrix declares with share() that those references are done.
+template<typename T>
+class matrix_buffer {
+	struct private_tag {};
+
+	public:
+	typedef T value_type;
+	typedef T* iterator;
+	typedef const T* const_iterator;
+
+	static constexpr std::size_t alignment = alignof(T)>cache_line ? alignof(T) : cache_line;
+
+	// large buffers from the default allocator are mapped on huge pages,
+	// which arrive zeroed: arithmetic elements are then not filled at all.
+	// Smaller zeroed arithmetic ones come from calloc instead of being filled
+	template<class Alloc = std::allocator<char>>
+	static std::shared_ptr<matrix_buffer<T>> create(std::size_t size, const Alloc& alloc = Alloc(),
+	                                                matrix_init init = matrix_init::value) {
+		const bool plain = std::is_same<Alloc, std::allocator<char>>::value;
+		std::shared_ptr<matrix_buffer<T>> buffer;
+		if (plain && use_huge_pages(size*sizeof(T)))
+			buffer = allocate(size, huge_page_allocator<char>(), init, std::is_arithmetic<T>::value);
+		else if (init==matrix_init::zeroed && std::is_arithmetic<T>::value && plain)
+			buffer = allocate(size, zeroed_allocator<char>(), init, true);
+		else
+			return allocate(size, alloc, init, false);
+		// chosen here for the default allocator: clones choose again
+		buffer->reallocate = &reallocate_default;
+		return buffer;
+	}
+
+	// only through create: the elements follow the object in its allocation
+	matrix_buffer(std::size_t size, matrix_init init, bool zero, private_tag) : count(size) {
+		const std::uintptr_t end = reinterpret_cast<std::uintptr_t>(this+1);
+		elements = reinterpret_cast<T*>((end + alignment-1) / alignment * alignment);
+		if (zero || (init==matrix_init::uninitialized && std::is_trivially_default_constructible<T>::value))
+			return;
+		std::size_t i=0;
+		try {
+			for (; i!=count; ++i) ::new(static_cast<void*>(elements+i)) T();
+		} catch(...) {
+			destroy(i);
+			throw;
+		}
+	}
+
+	~matrix_buffer() { destroy(count); }
+
+	matrix_buffer(const matrix_buffer<T>&) = delete;
+
+	matrix_buffer<T>& operator =(const matrix_buffer<T>& X) {
+		assert(count==X.count);
+		std::copy(X.begin(), X.end(), begin());
+		touch();
+		return *this;
+	}
+
+	T& operator [](std::size_t i) { return elements[i]; }
+	const T& operator [](std::size_t i) const { return elements[i]; }
+
+	T* data() { return elements; }
+	const T* data() const { return elements; }
+	std::size_t size() const { return count; }
+
+	iterator begin() { return elements; }
+	iterator end() { return elements + count; }
+	const_iterator begin() const { return elements; }
+	const_iterator end() const { return elements + count; }
+
+	void touch() { dirty.store(true, std::memory_order_relaxed); }
+
+	unsigned get_owners() const { return owners.load(std::memory_order_acquire); }
+	void add_owner() { owners.fetch_add(1, std::memory_order_relaxed); }
+	void drop_owner() { owners.fetch_sub(1, std::memory_order_acq_rel); }
+
+	bool is_shareable() const { return shareable.load(std::memory_order_acquire); }
+	void mark_unshareable() {
+		if (shareable.load(std::memory_order_relaxed)) shareable.store(false, std::memory_order_release);
+	}
+	void mark_shareable() { shareable.store(true, std::memory_order_release); }
+
+	// a buffer of the same size and contents as X, from the allocator of X,
+	// owned by one matrix
+	static std::shared_ptr<matrix_buffer<T>> clone(const std::shared_ptr<matrix_buffer<T>>& X) {
+		std::shared_ptr<matrix_buffer<T>> copy = X->reallocate(X);
+		std::copy(X->begin(), X->end(), copy->begin());
+		return copy;
+	}
+
+	// a token living exactly as long as the buffer, for holders that must
+	// notice its end without keeping its elements allocated, as a weak_ptr
+	// to the buffer would. Made on first request.
+	std::weak_ptr<const void> get_lifetime() const {
+		std::shared_ptr<const void> token = std::atomic_load(&lifetime);
+		if (!token) {
+			std::shared_ptr<const void> fresh = std::make_shared<char>();
+			if (std::atomic_compare_exchange_strong(&lifetime, &token, fresh)) token = fresh;
+		}
+		return token;
+	}
+
+	unsigned long get_version() {
+		if (dirty.exchange(false)) ++version;
+		return version;
+	}
+
+	private:
+	template<class Alloc>
+	static std::shared_ptr<matrix_buffer<T>> allocate(std::size_t size, const Alloc& alloc,
+	                                                  matrix_init init, bool zero) {
+		typedef block_deleter<matrix_buffer<T>,Alloc> deleter;
+		deleter release{typename deleter::base_allocator(alloc),
+		                sizeof(matrix_buffer<T>) + alignment + size*sizeof(T)};
+		char* const block = std::allocator_traits<typename deleter::base_allocator>::allocate(release.base, release.bytes);
+		matrix_buffer<T>* buffer;
+		try {
+			buffer = ::new(static_cast<void*>(block)) matrix_buffer<T>(size, init, zero, private_tag());
+		} catch(...) {
+			std::allocator_traits<typename deleter::base_allocator>::deallocate(release.base, block, release.bytes);
+			throw;
+		}
+		buffer->reallocate = &reallocate_from<Alloc>;
+		return std::shared_ptr<matrix_buffer<T>>(buffer, std::move(release));
+	}
+
+	// an uninitialised buffer of the size of X, from the allocator whose
+	// copy the deleter of X keeps
+	template<class Alloc>
+	static std::shared_ptr<matrix_buffer<T>> reallocate_from(const std::shared_ptr<matrix_buffer<T>>& X) {
+		typedef block_deleter<matrix_buffer<T>,Alloc> deleter;
+		return allocate(X->count, std::get_deleter<deleter>(X)->base, matrix_init::uninitialized, false);
+	}
+
+	static std::shared_ptr<matrix_buffer<T>> reallocate_default(const std::shared_ptr<matrix_buffer<T>>& X) {
+		return create(X->count, std::allocator<char>(), matrix_init::uninitialized);
+	}
+
+	void destroy(std::size_t n) {
+		while (n!=0) elements[--n].~T();
+	}
+
+	T* elements;
+	std::size_t count;
+	std::atomic<bool> dirty{false};
+	std::atomic<unsigned long> version{0};
+	std::atomic<unsigned> owners{1};
+	std::atomic<bool> shareable{true};
+	mutable std::shared_ptr<const void> lifetime;
+	std::shared_ptr<matrix_buffer<T>> (*reallocate)(const std::shared_ptr<matrix_buffer<T>>&);
+};
+
+
+// the storage of one matrix value: the matrix holds it, and so does every
+// view taken of it, while copies of the matrix get handles of their own on
+// the same buffer. A write through a handle whose buffer other handles hold
+// moves it to a private clone first, so views keep following the matrix
+// they were taken from and taking a view never changes anything.
+template<typename T>
+class matrix_handle {
+	public:
+	explicit matrix_handle(std::shared_ptr<matrix_buffer<T>> buffer) : buffer(std::move(buffer)) {}
+
+	template<class... Args>
+	static std::shared_ptr<matrix_handle<T>> create(std::size_t size, Args&&... args) {
+		return std::make_shared<matrix_handle<T>>(matrix_buffer<T>::create(size, std::forward<Args>(args)...));
+	}
+
+	~matrix_handle() { buffer->drop_owner(); }
+
+	matrix_handle(const matrix_handle<T>&) = delete;
+	matrix_handle<T>& operator =(const matrix_handle<T>&) = delete;
+
+	// the handle of a copy of the matrix: on the same buffer while it is
+	// shareable, on a clone otherwise
+	std::shared_ptr<matrix_handle<T>> copy() const {
+		if (!buffer->is_shareable())
+			return std::make_shared<matrix_handle<T>>(matrix_buffer<T>::clone(buffer));
+		buffer->add_owner();
+		return std::make_shared<matrix_handle<T>>(buffer);
+	}
+
+	const matrix_buffer<T>& read() const { return *buffer; }
+
+	// the buffer, private to this handle and marked written, for a write
+	// whose references do not outlive it
+	matrix_buffer<T>& detach() {
+		if (buffer->get_owners() > 1) {
+			std::shared_ptr<matrix_buffer<T>> own = matrix_buffer<T>::clone(buffer);
+			buffer->drop_owner();
+			buffer = std::move(own);
+		}
+		buffer->touch();
+		return *buffer;
+	}
+
+	// the same, for a mutable reference or iterator handed to the caller:
+	// the buffer is not shared again
+	matrix_buffer<T>& leak() {
+		matrix_buffer<T>& own = detach();
+		own.mark_unshareable();
+		return own;
+	}
+
+	// the references handed out by leak are no longer used: the buffer may
+	// be shared again, and the writes made through them move its version
+	void share() {
+		buffer->touch();
+		buffer->mark_shareable();
+	}
+
+	const std::shared_ptr<matrix_buffer<T>>& get_buffer() const { return buffer; }
+
+	private:
+	std::shared_ptr<matrix_buffer<T>> buffer;
+};
+
+#endif //_MATRIX_BUFFER_H_
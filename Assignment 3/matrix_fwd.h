@@ -14,4 +14,10 @@ template<typename T, class matrix_type=Plain> class matrix_ref;
 
 struct window_spec { unsigned row_start, row_end, col_start, col_end; };
 
+// direct access to the storage of a matrix: element (i,j) lives at
+// data[i*row_step + j*col_step]. data is nullptr when the matrix
+// cannot be addressed this way (e.g. Diagonal_matrix)
+template<typename T>
+struct raw_view { T* data; unsigned row_step, col_step; };
+
 #endif //_MATRIX_FWD_H_
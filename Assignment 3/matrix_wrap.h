@@ -165,7 +165,9 @@ template<typename T>
 struct matrix_wrap_impl {
 	virtual T& get(unsigned i, unsigned j) = 0;
 	virtual const T& get(unsigned i, unsigned j) const = 0;
-    virtual std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) = 0;
+    virtual std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) const = 0;
+	virtual raw_view<T> get_raw() const = 0;
+	virtual std::shared_ptr<matrix_buffer<T>> get_buffer() const = 0;
 	
 	virtual std::unique_ptr<matrix_wrap_impl<T>> clone() const = 0;
 	virtual ~matrix_wrap_impl() {}
@@ -194,8 +196,10 @@ class concrete_matrix_wrap_impl : public matrix_wrap_impl<T> {
 	public:
 	T& get(unsigned i, unsigned j) override { return mat(i,j); }
 	const T& get(unsigned i, unsigned j) const override { return mat(i,j); }
-    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c)
+    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) const
     override { return mat.get_sub(from_r, to_r, from_c, to_c); }
+	raw_view<T> get_raw() const override { return get_raw_view(mat); }
+	std::shared_ptr<matrix_buffer<T>> get_buffer() const override { return ::get_buffer(mat); }
 	
 	std::unique_ptr<matrix_wrap_impl<T>> clone() const override {
 		return std::make_unique<concrete_matrix_wrap_impl<T,matrix_type>>(mat);
@@ -286,8 +290,10 @@ class concrete_matrix_wrap_impl<T,Diagonal_matrix<decorated>> : public matrix_wr
 		}
 	const T& get(unsigned i, unsigned j) const override { return mat(i,j); }
 
-    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c)
+    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) const
     override { return mat.get_sub(from_r, to_r, from_c, to_c); }
+	raw_view<T> get_raw() const override { return {nullptr, 0, 0}; }
+	std::shared_ptr<matrix_buffer<T>> get_buffer() const override { return nullptr; }
 
 
 	std::unique_ptr<matrix_wrap_impl<T>> clone() const override {
@@ -370,6 +376,109 @@ class concrete_matrix_wrap_impl<T,Diagonal_matrix<decorated>> : public matrix_wr
 
 
 
+// window of a wrapped matrix whatever its concrete type: the offsets are
+// applied to the wrapped implementation instead of expanding a new
+// Window<decorated> type
+template<typename T>
+class window_wrap_impl : public matrix_wrap_impl<T> {
+	public:
+	T& get(unsigned i, unsigned j) override { return base->get(i+spec.row_start, j+spec.col_start); }
+	const T& get(unsigned i, unsigned j) const override {
+		const matrix_wrap_impl<T>& b = *base;
+		return b.get(i+spec.row_start, j+spec.col_start);
+	}
+    std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) const override {
+        assert(to_r+spec.row_start <= spec.row_end && to_c+spec.col_start <= spec.col_end);
+        return base->get_sub(from_r+spec.row_start, to_r+spec.row_start,
+                             from_c+spec.col_start, to_c+spec.col_start);
+    }
+	raw_view<T> get_raw() const override {
+		const raw_view<T> v = base->get_raw();
+		if (!v.data) return v;
+		return {v.data + spec.row_start*v.row_step + spec.col_start*v.col_step, v.row_step, v.col_step};
+	}
+	std::shared_ptr<matrix_buffer<T>> get_buffer() const override { return base->get_buffer(); }
+	
+	std::unique_ptr<matrix_wrap_impl<T>> clone() const override {
+		return std::make_unique<window_wrap_impl<T>>(base->clone(), spec);
+	}
+	
+	std::unique_ptr<matrix_wrap_impl<T>> transpose() const override {
+		return std::make_unique<window_wrap_impl<T>>(base->transpose(), window_spec{
+				spec.col_start, spec.col_end, spec.row_start, spec.row_end});
+	}
+	
+	std::unique_ptr<iterator_impl<T>> begin() override {
+		return std::make_unique<index_iterator_impl>(this, 0);
+	}
+	std::unique_ptr<iterator_impl<T>> end() override {
+		return std::make_unique<index_iterator_impl>(this, get_height());
+	}
+	std::unique_ptr<const_iterator_impl<T>> begin() const override {
+		return std::make_unique<const_index_iterator_impl>(this, 0);
+	}
+	std::unique_ptr<const_iterator_impl<T>> end() const override {
+		return std::make_unique<const_index_iterator_impl>(this, get_height());
+	}
+	
+	unsigned get_height() const override { return spec.row_end-spec.row_start; }
+	unsigned get_width() const override { return spec.col_end-spec.col_start; }
+	
+	window_wrap_impl(std::unique_ptr<matrix_wrap_impl<T>>&& M, window_spec win) : base(std::move(M)), spec(win) {
+		assert(spec.row_end<=base->get_height());
+		assert(spec.col_end<=base->get_width());
+	}
+	
+	private:
+	// row by row walk of the window
+	class index_iterator_impl : public iterator_impl<T> {
+		public:
+		index_iterator_impl(window_wrap_impl<T>* M, unsigned row) : mat(M), row(row), col(0) {}
+		
+		void increment() override {
+			if (++col==mat->get_width()) { col=0; ++row; }
+		}
+		T& dereference() override { return mat->get(row, col); }
+		bool is_equal(const iterator_impl<T>* X) const override {
+			const index_iterator_impl* Xp = dynamic_cast<const index_iterator_impl*>(X);
+			return Xp && mat==Xp->mat && row==Xp->row && col==Xp->col;
+		}
+		std::unique_ptr<iterator_impl<T>> clone() const override {
+			return std::make_unique<index_iterator_impl>(*this);
+		}
+		
+		private:
+		window_wrap_impl<T>* mat;
+		unsigned row, col;
+	};
+	
+	class const_index_iterator_impl : public const_iterator_impl<T> {
+		public:
+		const_index_iterator_impl(const window_wrap_impl<T>* M, unsigned row) : mat(M), row(row), col(0) {}
+		
+		void increment() override {
+			if (++col==mat->get_width()) { col=0; ++row; }
+		}
+		const T& dereference() override { return mat->get(row, col); }
+		bool is_equal(const const_iterator_impl<T>* X) const override {
+			const const_index_iterator_impl* Xp = dynamic_cast<const const_index_iterator_impl*>(X);
+			return Xp && mat==Xp->mat && row==Xp->row && col==Xp->col;
+		}
+		std::unique_ptr<const_iterator_impl<T>> clone() const override {
+			return std::make_unique<const_index_iterator_impl>(*this);
+		}
+		
+		private:
+		const window_wrap_impl<T>* mat;
+		unsigned row, col;
+	};
+	
+	std::unique_ptr<matrix_wrap_impl<T>> base;
+	window_spec spec;
+};
+
+
+
 template<typename T>
 class matrix_wrap {
 	public:
@@ -380,9 +489,15 @@ class matrix_wrap {
 	
 	
 	T& operator ()(unsigned i, unsigned j) { return pimpl->get(i,j); }
-	const T& operator ()(unsigned i, unsigned j) const { return pimpl->get(i,j); }
-	std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c)
+	// through the const implementation: reading must not mark the storage written
+	const T& operator ()(unsigned i, unsigned j) const {
+		const matrix_wrap_impl<T>& impl = *pimpl;
+		return impl.get(i,j);
+	}
+	std::vector<T> get_sub(unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) const
     { return pimpl->get_sub(from_r, to_r, from_c, to_c); }
+	raw_view<T> get_raw() const { return pimpl->get_raw(); }
+	std::shared_ptr<matrix_buffer<T>> get_buffer() const { return pimpl->get_buffer(); }
 	
 	iterator begin() { return pimpl->begin(); }
 	iterator end() { return pimpl->end(); }
@@ -391,6 +506,9 @@ class matrix_wrap {
 	
 	matrix_wrap(const matrix_wrap<T>& X) : pimpl(X.pimpl->clone()) {}
 	matrix_wrap transpose() const { return matrix_wrap(pimpl->transpose()); }
+	matrix_wrap window(window_spec spec) const {
+		return matrix_wrap(std::make_unique<window_wrap_impl<T>>(pimpl->clone(), spec));
+	}
 	
 	
 	template<class matrix_type>
@@ -400,6 +518,15 @@ class matrix_wrap {
 	unsigned get_height() const { return pimpl->get_height(); }
 	unsigned get_width() const { return pimpl->get_width(); }
 	
+	// true when both wrap the same elements of the same storage. The raw view
+	// carries the decorators: a transpose swaps the strides and a window moves
+	// the start, so equal views and shapes mean equal contents.
+	bool same_as(const matrix_wrap<T>& X) const {
+		const raw_view<T> a = get_raw(), b = X.get_raw();
+		return a.data && a.data==b.data && a.row_step==b.row_step && a.col_step==b.col_step
+				&& get_height()==X.get_height() && get_width()==X.get_width();
+	}
+	
 	private:
 	matrix_wrap(std::unique_ptr<matrix_wrap_impl<T>>&& impl) : pimpl(std::move(impl)) {}
 	
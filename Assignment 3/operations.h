@@ -3,19 +3,23 @@
 
 #include<type_traits>
 #include<list>
-#include<thread>
-#include<future>
+#include<map>
+#include<memory>
 #include<mutex>
+#include<utility>
+#include<thread>
+#include<array>
 #include <iostream>
 
 #include"matrix.h"
 #include"matrix_wrap.h"
 #include"exceptions.h"
-
-#define block_size 100
-
-std::mutex m;
-std::mutex m2;
+#include"gemm.h"
+#include"strassen.h"
+#include"thread_pool.h"
+#include"chain_plan.h"
+#include"result_cache.h"
+#include"temporary_pool.h"
 
 template<typename T, typename U>
 struct op_traits {
@@ -24,9 +28,237 @@ struct op_traits {
 };
 
 
+// columns of a row accumulated at a time by do_sum: the partial sums stay in
+// L1 while every term is streamed through them once
+constexpr unsigned sum_chunk = 2048;
+
+// rows [from_r, to_r) of result = sum of the terms
+template<typename T>
+void sum_rows(const matrix_wrap<T>& result, const std::vector<matrix_wrap<T>>& terms,
+              unsigned from_r, unsigned to_r) {
+    const unsigned width = result.get_width();
+    const raw_view<T> c = result.get_raw();
+    if (!c.data || c.col_step!=1) {
+        matrix_wrap<T> dest = result;
+        for (unsigned i=from_r; i!=to_r; ++i)
+            for (unsigned j=0; j!=width; ++j) {
+                T sum = terms[0](i,j);
+                for (unsigned t=1; t!=terms.size(); ++t) sum = sum + terms[t](i,j);
+                dest(i,j) = sum;
+            }
+        return;
+    }
+    std::vector<raw_view<T>> views;
+    for (const auto& term: terms) views.push_back(term.get_raw());
+    const add_kernel<T> kernel = select_add_kernel<T>();
+    for (unsigned i=from_r; i!=to_r; ++i)
+        for (unsigned j0=0; j0<width; j0+=sum_chunk) {
+            const unsigned n = std::min(sum_chunk, width-j0);
+            T* dest = c.data + i*c.row_step + j0;
+            for (unsigned t=0; t!=terms.size(); ++t) {
+                const raw_view<T> v = views[t];
+                const T* src = v.data + i*v.row_step + j0*v.col_step;
+                if (v.data && v.col_step==1) {
+                    if (t==0) std::copy(src, src+n, dest);
+                    else kernel(dest, dest, src, n);
+                } else if (v.data) {
+                    for (unsigned j=0; j!=n; ++j)
+                        dest[j] = t==0 ? src[j*v.col_step] : dest[j] + src[j*v.col_step];
+                } else {
+                    for (unsigned j=0; j!=n; ++j)
+                        dest[j] = t==0 ? terms[t](i, j0+j) : dest[j] + terms[t](i, j0+j);
+                }
+            }
+        }
+}
+
+// result = sum of the terms in a single pass over memory, in bands of rows
+// computed by the pool. No temporary is allocated.
+template<typename T>
+void do_sum(matrix_wrap<T> result, const std::list<matrix_wrap<T>>& terms) {
+    const std::vector<matrix_wrap<T>> operands(terms.begin(), terms.end());
+    const unsigned height = result.get_height();
+    const unsigned width = result.get_width();
+    const unsigned bands = std::max(1u, std::min({thread_pool::instance().size()+1, height,
+            unsigned(std::size_t(height)*width*operands.size() >> 16)}));
+    if (bands == 1) return sum_rows<T>(result, operands, 0, height);
+    task_group tasks;
+    for (unsigned b=0; b!=bands; ++b)
+        tasks.run([&, b] { sum_rows<T>(result, operands, height*b/bands, height*(b+1)/bands); });
+    tasks.wait();
+}
+
+
+// ***** Vector sweeps ******* //
+// *************************** //
+// single rows and columns of an expression, computed without evaluating it
+
+// dest[0..n) += row i of M, columns [0, n)
+template<typename T>
+void add_row(T* dest, const matrix_wrap<T>& M, unsigned i) {
+    const unsigned n = M.get_width();
+    const raw_view<T> v = M.get_raw();
+    if (v.data && v.col_step==1) {
+        const T* src = v.data + i*v.row_step;
+        for (unsigned j=0; j!=n; ++j) dest[j] += src[j];
+    } else if (v.data) {
+        for (unsigned j=0; j!=n; ++j) dest[j] += v.data[i*v.row_step + j*v.col_step];
+    } else {
+        for (unsigned j=0; j!=n; ++j) dest[j] += M(i,j);
+    }
+}
+
+// dest[0..n) += column j of M, rows [0, n)
+template<typename T>
+void add_col(T* dest, const matrix_wrap<T>& M, unsigned j) {
+    const unsigned n = M.get_height();
+    const raw_view<T> v = M.get_raw();
+    if (v.data) {
+        for (unsigned i=0; i!=n; ++i) dest[i] += v.data[i*v.row_step + j*v.col_step];
+    } else {
+        for (unsigned i=0; i!=n; ++i) dest[i] += M(i,j);
+    }
+}
+
+// row vector times M: rows of M scaled and accumulated, so contiguous
+// storage is walked along its rows
+template<typename T>
+std::vector<T> row_times(const std::vector<T>& x, const matrix_wrap<T>& M) {
+    std::vector<T> y(M.get_width(), T(0));
+    const raw_view<T> v = M.get_raw();
+    for (unsigned k=0; k!=x.size(); ++k) {
+        const T a = x[k];
+        if (v.data) {
+            const T* src = v.data + k*v.row_step;
+            for (unsigned j=0; j!=y.size(); ++j) y[j] += a*src[j*v.col_step];
+        } else {
+            for (unsigned j=0; j!=y.size(); ++j) y[j] += a*M(k,j);
+        }
+    }
+    return y;
+}
+
+// M times column vector: one dot product per row of M
+template<typename T>
+std::vector<T> times_col(const matrix_wrap<T>& M, const std::vector<T>& x) {
+    std::vector<T> y(M.get_height(), T(0));
+    const raw_view<T> v = M.get_raw();
+    for (unsigned i=0; i!=y.size(); ++i) {
+        T sum = T(0);
+        if (v.data) {
+            const T* src = v.data + i*v.row_step;
+            for (unsigned k=0; k!=x.size(); ++k) sum += src[k*v.col_step]*x[k];
+        } else {
+            for (unsigned k=0; k!=x.size(); ++k) sum += M(i,k)*x[k];
+        }
+        y[i] = sum;
+    }
+    return y;
+}
+
+// row i of L times column j of R
+template<typename T>
+T row_dot_col(const matrix_wrap<T>& L, unsigned i, const matrix_wrap<T>& R, unsigned j) {
+    const unsigned n = L.get_width();
+    const raw_view<T> l = L.get_raw(), r = R.get_raw();
+    T sum = T(0);
+    if (l.data && r.data) {
+        const T* x = l.data + i*l.row_step;
+        const T* y = r.data + j*r.col_step;
+        for (unsigned k=0; k!=n; ++k) sum += x[k*l.col_step]*y[k*r.row_step];
+    } else {
+        for (unsigned k=0; k!=n; ++k) sum += L(i,k)*R(k,j);
+    }
+    return sum;
+}
+
+// row i of chain[0] * ... * chain[n-1], swept left to right
+template<typename T>
+std::vector<T> chain_row(const std::vector<matrix_wrap<T>>& chain, unsigned n, unsigned i) {
+    std::vector<T> x(chain.front().get_width(), T(0));
+    add_row(x.data(), chain.front(), i);
+    for (unsigned t=1; t!=n; ++t) x = row_times(x, chain[t]);
+    return x;
+}
+
+// column j of chain[0] * ... * chain[n-1], swept right to left
+template<typename T>
+std::vector<T> chain_col(const std::vector<matrix_wrap<T>>& chain, unsigned j) {
+    std::vector<T> x(chain.back().get_height(), T(0));
+    add_col(x.data(), chain.back(), j);
+    for (unsigned t=chain.size()-1; t--!=0;) x = times_col(chain[t], x);
+    return x;
+}
+
+
+// ***** Common operands ******* //
+// ***************************** //
+
+// id of every operand: the position of the first operand wrapping the same
+// matrix, so repeated factors and their sub-chains compare equal
+template<class container>
+std::vector<unsigned> operand_ids(const container& mats) {
+    std::vector<unsigned> ids;
+    for (auto mat=mats.begin(); mat!=mats.end(); ++mat) {
+        unsigned id = ids.size(), pos = 0;
+        for (auto other=mats.begin(); other!=mat; ++other, ++pos)
+            if (other->same_as(*mat)) {
+                id = ids[pos];
+                break;
+            }
+        ids.push_back(id);
+    }
+    return ids;
+}
+
+// true when both lists wrap the same matrices in the same order
+template<class container>
+bool same_operands(const container& a, const container& b) {
+    return a.size()==b.size() && std::equal(a.begin(), a.end(), b.begin(),
+            [](const auto& x, const auto& y) { return x.same_as(y); });
+}
+
+// dims[i] x dims[i+1] is the size of chain[i]
+template<typename T>
+std::vector<unsigned> chain_dims(const std::vector<matrix_wrap<T>>& chain) {
+    std::vector<unsigned> dims;
+    for (const auto& mat : chain) dims.push_back(mat.get_height());
+    dims.push_back(chain.back().get_width());
+    return dims;
+}
+
+
+// ***** Budgeted forks ******* //
+// *************************** //
+
+// f and g, concurrently when the temporaries both hold at their peaks fit
+// within the limit of the temporary pool. Otherwise one after the other, in
+// the order holding least at once: the result the first one keeps is held
+// while the second runs.
+template<class F, class G>
+void budgeted_fork_join(double f_peak, double f_kept, double g_peak, double g_kept, F&& f, G&& g) {
+    if (temporary_pool::instance().admits(f_peak + g_peak))
+        return task_group::fork_join(f, g);
+    if (std::max(f_peak, f_kept + g_peak) <= std::max(g_peak, g_kept + f_peak)) {
+        f();
+        g();
+    } else {
+        g();
+        f();
+    }
+}
+
+
 template<typename T, unsigned h, unsigned w>
 class matrix_product;
 
+template<typename T, unsigned... dims>
+class sized_product;
+
+// true when both dimensions of the matrix are known at compile time
+template<typename T, class matrix_type>
+constexpr bool is_sized() { return matrix_ref<T,matrix_type>::H*matrix_ref<T,matrix_type>::W!=0; }
+
 template<typename T, unsigned h, unsigned w>
 class matrix_addition{
 public:
@@ -35,15 +267,8 @@ public:
     static constexpr unsigned W=w;
 
     operator matrix<T>() {
-        resolve();
-        matrix_wrap<T> lhs=matrices.front(), rhs=matrices.back();
-        assert(lhs.get_width()==rhs.get_width() || lhs.get_height()==rhs.get_height());
-        const unsigned height = lhs.get_height();
-        const unsigned width = lhs.get_width();
-        matrix<T> result(height, width);
-        for (unsigned i=0; i!=height; ++i)
-            for (unsigned j=0; j!=width; j++)
-                result(i,j) = lhs(i,j) + rhs(i,j);
+        matrix<T> result(get_height(), get_width(), matrix_init::uninitialized);
+        do_sum<T>(result, matrices);
         std::cerr << "addition conversion\n";
         return result;
     }
@@ -52,18 +277,39 @@ public:
     operator matrix<T,h2,w2>(){
         static_assert((h==0 || h==h2) && (w==0 || w==w2), "sized addition conversion to wrong sized matrix");
         assert(h2==get_height() && w2==get_width());
-        resolve();
-        matrix_wrap<T> lhs=matrices.front(), rhs=matrices.back();
-        matrix<T,h2,w2> result;
-        for(unsigned i=0; i!=H; ++i)
-            for(unsigned j=0; j!=W; ++j)
-                result(i,j) = lhs(i,j) + rhs(i,j);
+        matrix<T,h2,w2> result(matrix_init::uninitialized);
+        do_sum<T>(result, matrices);
         std::cerr << "sized addition conversion\n";
         return result;
     };
 
     unsigned get_height() const { return matrices.front().get_height(); }
     unsigned get_width() const { return matrices.back().get_width(); }
+    std::list<matrix_wrap<T>> get_mats() const { return matrices; }
+
+    // single entries, rows and columns of the sum, read without evaluating it
+    T operator ()(unsigned i, unsigned j) const {
+        T sum = T(0);
+        for (const auto& mat : matrices) sum += mat(i,j);
+        return sum;
+    }
+    matrix<T> row(unsigned i) const {
+        matrix<T> result(1, get_width(), matrix_init::zeroed);
+        for (const auto& mat : matrices) add_row(&*result.begin(), mat, i);
+        return result;
+    }
+    matrix<T> col(unsigned j) const {
+        matrix<T> result(get_height(), 1, matrix_init::zeroed);
+        for (const auto& mat : matrices) add_col(&*result.begin(), mat, j);
+        return result;
+    }
+
+    // sum of the same window of every term, still unevaluated
+    matrix_addition<T,0,0> window(window_spec spec) const {
+        matrix_addition<T,0,0> result;
+        for (const auto& mat : matrices) result.matrices.push_back(mat.window(spec));
+        return result;
+    }
 
     template<typename Z, class LType, typename U, class RType>
     friend std::enable_if_t<std::is_same<Z,U>::value,
@@ -90,13 +336,15 @@ public:
     friend std::enable_if_t<std::is_same<Z,U>::value, matrix_addition<Z,h3,w3>>
     operator + (matrix_addition<Z,h3,w3>&& lhs, matrix_addition<U,h2,w2>&& rhs);
 
-    template<typename U, unsigned h2, unsigned w2>
-    friend void force_addition(matrix_addition<U,h2,w2>&& sum, std::promise<matrix<U>> promise);
+    template<typename U, unsigned h2, unsigned w2, class result_type>
+    friend void force_addition(matrix_addition<U,h2,w2>&& sum, const matrix_ref<U,result_type>& result);
 
 
     matrix_addition(matrix_addition<T,h,w>&& X) = default;
 
 private:
+    template<typename, unsigned, unsigned> friend class matrix_addition;
+
     matrix_addition()=default;
 
     template<unsigned w2>
@@ -107,60 +355,15 @@ private:
         matrices.emplace_back(mat);
     }
 
-    void resolve(){
-        std::unique_lock<std::mutex> lock(m2, std::defer_lock);
-        std::vector<std::thread> threads;
-
-        if(matrices.size() > 2){
-            lock.lock();
-            // this is safe because I know that I never start a new thread using already working matrices
-            // and they are not going to change the list 'matrices' until I release the lock.
-            // + new threads are started once all old threads have finished their execution.
-            for(int k=0; k < matrices.size(); k=k+2)
-                if(k+1 < matrices.size()){
-                    typename std::list<matrix_wrap<T>>::iterator lhs = std::next(matrices.begin(), k);
-                    typename std::list<matrix_wrap<T>>::iterator rhs = lhs;
-                    ++rhs;
-                    try {
-                        threads.emplace_back(std::thread([this, lhs, rhs] {
-                            const unsigned height = lhs->get_height();
-                            const unsigned width = lhs->get_width();
-                            assert(width == rhs->get_width() && height == rhs->get_height());
-                            std::unique_lock<std::mutex> locke(m2, std::defer_lock);
-                            matrix<T> result(height,width);
-                            for (unsigned i = 0; i != height; ++i)
-                                for (unsigned j = 0; j != width; ++j)
-                                    result(i,j) = (*lhs)(i,j) + (*rhs)(i,j);
-
-                            locke.lock();
-                            matrices.erase(rhs);
-                            matrices.emplace(lhs, result);
-                            matrices.erase(lhs);
-                            locke.unlock();
-                        }));
-                    }catch(...) { handle_exception(); }
-                }
-            lock.unlock();
-            for(auto & t : threads) {t.join();}
-            threads.clear();
-        }
-    }
-
     std::list<matrix_wrap<T>> matrices;
 };
 
-template<typename T, unsigned h, unsigned w>
-void force_addition(matrix_addition<T,h,w>&& sum, std::promise<matrix<T>> promise){
-    sum.resolve();
-    matrix_wrap<T> lhs=sum.matrices.front(), rhs=sum.matrices.back();
-    assert(lhs.get_width()==rhs.get_width() || lhs.get_height()==rhs.get_height());
-    const unsigned height = lhs.get_height();
-    const unsigned width = lhs.get_width();
-    matrix<T> result(height, width);
-    for (unsigned i=0; i!=height; ++i)
-        for (unsigned j=0; j!=width; j++)
-            result(i,j) = lhs(i,j) + rhs(i,j);
-    promise.set_value(result);
+// evaluates sum into result, already of the right size
+template<typename T, unsigned h, unsigned w, class result_type>
+void force_addition(matrix_addition<T,h,w>&& sum, const matrix_ref<T,result_type>& result){
+    // written through its raw view: detached from copies and versioned
+    prepare_write(result);
+    do_sum<T>(result, sum.matrices);
 };
 
 // ***** Addition operators ******* //
@@ -189,7 +392,7 @@ operator + (const matrix_ref<T,LType>& left, const matrix_ref<U,RType>& right) {
         throw std::domain_error("dimension mismatch in Matrix addition");
     const unsigned height=left.get_height();
     const unsigned width=left.get_width();
-    matrix<typename op_traits<T,U>::sum_type> result(height, width);
+    matrix<typename op_traits<T,U>::sum_type> result(height, width, matrix_init::uninitialized);
     for (unsigned i=0; i!=height; ++i)
         for (unsigned j=0; j!=width; j++)
             result(i,j) = left(i,j) + right(i,j);
@@ -237,7 +440,7 @@ operator + (matrix_addition<T,h,w>&& lhs, const matrix_ref<U,RType>& rhs){
     const unsigned height = rhs.get_height();
     const unsigned width = rhs.get_width();
     matrix<T> left = lhs;
-    matrix<typename op_traits<T,U>::sum_type> result(height, width);
+    matrix<typename op_traits<T,U>::sum_type> result(height, width, matrix_init::uninitialized);
     for(unsigned i=0; i!=height; ++i)
         for(unsigned j=0; j!=width; ++j)
             result(i,j) = left(i,j) + rhs(i,j);
@@ -268,89 +471,43 @@ operator + (matrix_addition<T,h,w>&& lhs, matrix_addition<U,h2,w2>&& rhs){
     static_assert(h*w*h2*w2==0 || (h==h2 && w==w2), "dimension mismatch in Matrix addition");
     if(lhs.get_width()!=rhs.get_width() || lhs.get_height()!=rhs.get_height())
         throw std::domain_error("dimension mismatch in Matrix addition");
-    std::promise<matrix<T>> lhs_promise;
-    std::promise<matrix<U>> rhs_promise;
-    auto lhs_future = lhs_promise.get_future();
-    auto rhs_future = rhs_promise.get_future();
-    matrix_addition<T, h, w2> result;
-    try {
-        std::thread th1(force_addition<T, h, w>, std::move(lhs), std::move(lhs_promise));
-        std::thread th2(force_addition<U, h2, w2>, std::move(rhs), std::move(rhs_promise));
-        result.add(lhs_future.get());
-        result.add(rhs_future.get());
-        th1.join();
-        th2.join();
-    }catch(...){ handle_exception(); }
-
+    // both sums are merged into one, evaluated in a single pass
+    matrix_addition<T, h, w> result(std::move(lhs));
+    result.matrices.splice(result.matrices.end(), rhs.matrices);
     return result;
 };
 
 
-template<typename T, typename U>
-void sub_multiply(matrix_wrap<typename op_traits<T,U>::prod_type> result,
-                  matrix_wrap<T> lhs, matrix_wrap<U> rhs, unsigned i, unsigned j){
-    const unsigned lh = lhs.get_height();
-    const unsigned lw = lhs.get_width(); // lw==rh
-    const unsigned rh = rhs.get_height();// rh==lw
-    const unsigned rw = rhs.get_width();
-    const unsigned to_i = std::min(i+block_size, lh);
-    const unsigned to_j = std::min(j+block_size, rw);
-    unsigned b1_width = 0, b2_width = 0, span = 0;
-    std::vector<T> block1;
-    std::vector<U> block2;
-    for(unsigned ii=i; ii<to_i; ++ii)
-        for (unsigned jj=j; jj<to_j; ++jj)
-            result(ii, jj) = 0;
-
-    for(unsigned k=0; k<lw; k=k+block_size) {
-        block1 = lhs.get_sub(i, to_i, k, std::min(k+block_size, lw));
-        b1_width = std::min(k+block_size, lw) - k;
-        block2 = rhs.get_sub(k, std::min(k+block_size, rh), j, to_j);
-        b2_width = to_j - j;
-        span = b1_width;
-        for(unsigned ii=i; ii<to_i; ++ii) {
-            for (unsigned jj=j; jj<to_j; ++jj) {
-                for(unsigned b=0; b!=span; ++b)
-                    result(ii, jj) += block1[(b1_width*(ii-i))+b] * block2[(b2_width*b)+(jj-j)];
-            }
-        }
-        block1.clear();
-        block2.clear();
-    }
-}
-
+// products into results that cannot be written row by row (a transposed
+// view, a diagonal): computed by the packed kernel into a temporary, whose
+// entries are then copied across
 template<typename T, typename U>
 void do_multiply(matrix_wrap<typename op_traits<T,U>::prod_type> result,
                  const matrix_wrap<T> lhs, const matrix_wrap<U> rhs) {
+    typedef typename op_traits<T,U>::prod_type R;
     const unsigned height = result.get_height();
     const unsigned width = result.get_width();
-    const unsigned span = lhs.get_width();
     // dimension check not needed since it is made from function which called this
-    // assert(span==rhs.get_height());
+    // assert(lhs.get_width()==rhs.get_height());
+    const matrix<R> product(height, width, pool_allocator<char>(), matrix_init::uninitialized);
+    const raw_view<R> p = get_raw_view(product);
+    gemm_multiply(p, height, width, lhs, rhs);
+    const raw_view<R> c = result.get_raw();
     for (unsigned i=0; i!=height; ++i)
         for (unsigned j=0; j!=width; ++j) {
-            result(i,j)=0;
-            for (unsigned k=0; k!=span; ++k)
-                result(i,j) += lhs(i,k)*rhs(k,j);
+            if (c.data) c.data[i*c.row_step + j*c.col_step] = p.data[i*p.row_step + j];
+            else result(i,j) = p.data[i*p.row_step + j];
         }
 }
 
 template<typename T, typename U>
 void do_parallel_multiply(matrix_wrap<typename op_traits<T,U>::prod_type> result, const matrix_wrap<T> lhs, const matrix_wrap<U> rhs) {
-    std::list<std::thread> threads;
-    const unsigned height = result.get_height();
-    const unsigned width = result.get_width();
+    typedef typename op_traits<T,U>::prod_type R;
+    const raw_view<R> c = result.get_raw();
     // dimension check not needed since it is made from function which called this
     // assert(lhs.get_width()==rhs.get_height());
-    if(height < block_size || width < block_size) return do_multiply<T,U>(result, lhs, rhs);
-    for(unsigned i=0; i<height; i=i+block_size) {
-        for (unsigned j = 0; j < width; j = j + block_size) {
-            // call thread on block C_{i, i+block_size, j, j+block_size}
-            threads.emplace_back(sub_multiply<T, U>, result, lhs, rhs, i, j);
-        }
-    }
-    for(auto& t: threads) { t.join(); }
-    threads.clear();
+    if(!c.data || c.col_step!=1) return do_multiply<T,U>(result, lhs, rhs);
+    gemm_multiply(c, result.get_height(), result.get_width(), lhs, rhs);
 }
 
 template<typename T,unsigned h, unsigned w>
@@ -361,14 +518,8 @@ class matrix_product {
 	static constexpr unsigned W=w;
 
 	operator matrix<T>() {
-		resolve();
-		matrix_wrap<T> lhs=matrices.front(), rhs=matrices.back();
-		const unsigned height = lhs.get_height();
-		const unsigned width = rhs.get_width();
-		const unsigned span = lhs.get_width();
-		assert(span==rhs.get_height());
-		matrix<T> result(height, width);
-        try{ do_parallel_multiply<T,T>(result, lhs, rhs); }
+		matrix<T> result(get_height(), get_width(), matrix_init::uninitialized);
+        try{ evaluate(result); }
         catch(...) { handle_exception(); }
 		std::cerr << "product conversion\n";
 		return result;
@@ -378,12 +529,8 @@ class matrix_product {
 	operator matrix<T,h2,w2>() {
 		static_assert((h==0 || h==h2) && (w==0 || w==w2), "sized product conversion to wrong sized matrix");
 		assert(h2==get_height() && w2==get_width());
-		resolve();
-		matrix_wrap<T> lhs=matrices.front(), rhs=matrices.back();
-		const unsigned span = lhs.get_width();
-		assert(span==rhs.get_height());
-		matrix<T,h2,w2> result;
-		try{ do_parallel_multiply<T,T>(result, lhs, rhs); }
+		matrix<T,h2,w2> result(matrix_init::uninitialized);
+		try{ evaluate(result); }
         catch(...) { handle_exception(); }
 		std::cerr << "sized product conversion\n";
 		return result;				
@@ -391,13 +538,129 @@ class matrix_product {
 	
 	unsigned get_height() const { return matrices.front().get_height(); }
 	unsigned get_width() const { return matrices.back().get_width(); }
-    std::list<matrix_wrap<T>> get_mats() const { return matrices; }
-    std::list<unsigned> get_sizes() const { return sizes; }
-    std::list<bool> get_busy() const { return busy; }
+    std::vector<matrix_wrap<T>> get_mats() const { return matrices; }
+    unsigned get_strassen_cutoff() const { return strassen_cutoff; }
+
+    // bytes of temporaries the evaluation holds at most at once, by its plan
+    double get_temporary_bytes() const {
+        const chain_plan plan(chain_dims(matrices), sizeof(T), operand_ids(matrices),
+                              temporary_pool::instance().headroom());
+        return plan.peak(0, plan.size()-1);
+    }
+
+    // single entries, rows and columns of the product, read without evaluating
+    // it: a vector is swept through the chain, so an entry costs one
+    // matrix-vector product per factor instead of the whole chain
+    T operator ()(unsigned i, unsigned j) const {
+        const std::vector<T> x = chain_row(matrices, matrices.size()-1, i);
+        std::vector<T> y(x.size(), T(0));
+        add_col(y.data(), matrices.back(), j);
+        T sum = T(0);
+        for (unsigned k=0; k!=x.size(); ++k) sum += x[k]*y[k];
+        return sum;
+    }
+    matrix<T> row(unsigned i) const {
+        matrix<T> result(1, get_width(), matrix_init::uninitialized);
+        const std::vector<T> x = chain_row(matrices, matrices.size(), i);
+        std::copy(x.begin(), x.end(), result.begin());
+        return result;
+    }
+    matrix<T> col(unsigned j) const {
+        matrix<T> result(get_height(), 1, matrix_init::uninitialized);
+        const std::vector<T> x = chain_col(matrices, j);
+        std::copy(x.begin(), x.end(), result.begin());
+        return result;
+    }
+
+    // the diagonal of the product, without evaluating it. Only the leading
+    // square block of the product takes part: the first factor keeps m rows
+    // and the last m columns. The chain is cut in two, and entry i is row i
+    // of the left half times column i of the right half. Each half is either
+    // formed along its plan or swept a row (a column) at a time through its
+    // factors, whichever costs less, and the cut is where the total is least.
+    // Two factors, or chains with thin outer factors, cost O(n^2); a longer
+    // chain of square factors still costs a product of two of them.
+    matrix<T> diagonal() const {
+        const unsigned m = std::min(get_height(), get_width());
+        const chain_evaluation chain = prepare(window({0, m, 0, m}).matrices);
+        const chain_plan& plan = chain.plan;
+        const std::vector<unsigned> dims = chain_dims(chain.factors);
+        const unsigned n = plan.size();
+        // m rows swept through factors [1, k], m columns through [k+1, n-2]:
+        // every vector reads each factor it goes through again
+        const auto sweep = [&](unsigned t) { return m*(2.0 + chain_byte_cost*sizeof(T))*dims[t]*dims[t+1]; };
+        std::vector<double> row_sweep(n, 0.0), col_sweep(n, 0.0);
+        for(unsigned t=1; t!=n; ++t) row_sweep[t] = row_sweep[t-1] + sweep(t);
+        for(unsigned t=n-1; t--!=0;) col_sweep[t] = col_sweep[t+1] + sweep(t);
+        const auto left_cost = [&](unsigned k) { return std::min(plan.cost(0,k), row_sweep[k]); };
+        const auto right_cost = [&](unsigned k) { return std::min(plan.cost(k+1,n-1), col_sweep[k+1]); };
+        unsigned k = 0;
+        for(unsigned t=1; t+1<n; ++t)
+            if(left_cost(t) + right_cost(t) + 2.0*m*dims[t+1] < left_cost(k) + right_cost(k) + 2.0*m*dims[k+1]) k = t;
+        const bool form_left = plan.cost(0,k) <= row_sweep[k];
+        const bool form_right = plan.cost(k+1,n-1) <= col_sweep[k+1];
+        std::unique_ptr<matrix_wrap<T>> lhs, rhs;
+        budgeted_fork_join(form_left ? plan.peak(0,k) : 0.0, form_left ? plan.kept(0,k) : 0.0,
+                           form_right ? plan.peak(k+1,n-1) : 0.0, form_right ? plan.kept(k+1,n-1) : 0.0,
+                           [&] { if(form_left) lhs = operand(chain, 0, k); },
+                           [&] { if(form_right) rhs = operand(chain, k+1, n-1); });
+        matrix<T> result(m, 1, matrix_init::uninitialized);
+        if(lhs && rhs) {
+            for(unsigned i=0; i!=m; ++i) result(i,0) = row_dot_col(*lhs, i, *rhs, i);
+            return result;
+        }
+        const std::vector<matrix_wrap<T>> left(chain.factors.begin(), chain.factors.begin()+k+1);
+        const std::vector<matrix_wrap<T>> right(chain.factors.begin()+k+1, chain.factors.end());
+        for(unsigned i=0; i!=m; ++i) {
+            std::vector<T> x(dims[k+1], T(0)), y(dims[k+1], T(0));
+            if(lhs) add_row(x.data(), *lhs, i);
+            else x = chain_row(left, left.size(), i);
+            if(rhs) add_col(y.data(), *rhs, i);
+            else y = chain_col(right, i);
+            T sum = T(0);
+            for(unsigned t=0; t!=x.size(); ++t) sum += x[t]*y[t];
+            result(i,0) = sum;
+        }
+        return result;
+    }
+
+    T trace() const {
+        const matrix<T> diag = diagonal();
+        T sum = T(0);
+        for(const T& x : diag) sum += x;
+        return sum;
+    }
+
+    // the product as a plain matrix. With the result cache on, a product of
+    // unchanged operands computed before is shared instead of evaluated again,
+    // until either the cache's copy or this one is written.
+    matrix_ref<T,Plain> materialise() const {
+        return compute(prepare(matrices), 0, matrices.size()-1);
+    }
+
+    // the block of the product selected by spec, still unevaluated: only the
+    // requested rows of the first factor and columns of the last take part
+    matrix_product<T,0,0> window(window_spec spec) const {
+        matrix_product<T,0,0> result;
+        const matrix_wrap<T>& first = matrices.front();
+        const matrix_wrap<T>& last = matrices.back();
+        result.matrices.push_back(first.window({spec.row_start, spec.row_end, 0, first.get_width()}));
+        for (unsigned t=1; t+1<matrices.size(); ++t) result.matrices.push_back(matrices[t]);
+        result.matrices.push_back(last.window({0, last.get_height(), spec.col_start, spec.col_end}));
+        result.strassen_cutoff = strassen_cutoff;
+        return result;
+    }
+
+    // opt-in Strassen-Winograd evaluation of the products of this expression,
+    // recursing down to cutoff x cutoff blocks
+    matrix_product<T,h,w> strassen(unsigned cutoff=strassen_default_cutoff) && {
+        strassen_cutoff = cutoff;
+        return std::move(*this);
+    }
 
 
     template<typename Z, typename U, class LType, class RType>
-    friend std::enable_if_t<std::is_same<Z,U>::value,
+    friend std::enable_if_t<std::is_same<Z,U>::value && !(is_sized<Z,LType>() && is_sized<U,RType>()),
             matrix_product<Z, matrix_ref<Z,LType>::H, matrix_ref<U,RType>::W>>
     operator * (const matrix_ref<Z,LType>& lhs, const matrix_ref<U,RType>& rhs);
 
@@ -417,163 +680,330 @@ class matrix_product {
     friend std::enable_if_t<std::is_same<Z,U>::value, matrix_product<Z,matrix_ref<U,RType>::H,w2>>
     operator * (const matrix_ref<U,RType>& lhs, matrix_addition<Z,h2,w2>&& rhs);
 
-    template<typename Z, unsigned h2, unsigned w2>
-    friend void force_multiplication(matrix_product<Z,h2,w2>&& prod, std::promise<matrix<Z>> promise);
-
-    template<typename Z, unsigned h2, unsigned w2>
-    friend void force_mult_stat(matrix_product<Z,h2,w2>&& prod, std::promise<matrix<Z,h2,w2>> promise);
+    template<typename Z, unsigned h2, unsigned w2, class result_type>
+    friend void force_multiplication(matrix_product<Z,h2,w2>&& prod, const matrix_ref<Z,result_type>& result);
 
     matrix_product(matrix_product<T,h,w>&& X) = default;
 
-	private:
+	protected:
+    template<typename, unsigned, unsigned> friend class matrix_product;
 
 	matrix_product()=default;
 
     template<unsigned w2>
     matrix_product(matrix_product<T,h,w2>&& X) : matrices(std::move(X.get_mats())),
-                                                 sizes(std::move(X.get_sizes())),
-                                                 busy(std::move(X.get_busy()))  {}
+                                                 strassen_cutoff(X.get_strassen_cutoff()) {}
 
 	template<class matrix_type>
 	void add(matrix_ref<T,matrix_type> mat) {
 		matrices.emplace_back(mat);
-		sizes.push_back(mat.get_width());
-        busy.push_back(false);
 	}
 
-    unsigned non_busy(){
-        unsigned nr = 0;
-        for(std::list<bool>::iterator val=busy.begin(); val!=busy.end(); ++val)
-            if(*val == false) nr++;
-        return nr;
-    }
-
-    void resolve() {
-        bool found = true;
-        int pos_lhs;
-        std::unique_lock<std::mutex> lock(m, std::defer_lock);
-        std::vector<std::thread> threads;
-        while(matrices.size()>2){
-            lock.lock();
-            while(found && non_busy()>1){
-                found = false;
-                pos_lhs = -1;
-                typename std::list<matrix_wrap<T>>::iterator lhs = find_max(&pos_lhs);
-                if(pos_lhs > -1) {
-                    found = true;
-                    typename std::list<matrix_wrap<T>>::iterator rhs = lhs;
-                    ++rhs;
-                    std::list<unsigned>::iterator one_size = std::next(sizes.begin(), pos_lhs);
-                    std::list<unsigned>::iterator two_size = one_size; ++two_size;
-                    std::list<bool>::iterator one_busy = std::next(busy.begin(), pos_lhs);
-                    std::list<bool>::iterator two_busy = one_busy; ++two_busy;
-                    *one_busy = true;
-                    *two_busy = true;
-
-                    try{
-                    threads.emplace_back(std::thread([this, lhs, rhs, one_size, two_size, one_busy, two_busy]{
-                        // lock ON
-                        std::unique_lock<std::mutex> locke(m, std::defer_lock);
-                        locke.lock();
-                        typename std::list<matrix_wrap<T>>::iterator result=matrices.emplace(lhs, matrix<T>(lhs->get_height(), rhs->get_width()));
-                        std::list<bool>::iterator newb = busy.emplace(one_busy, true);
-                        std::list<unsigned>::iterator news =  sizes.emplace(one_size, 0);
-                        locke.unlock();
-                        // lock OFF
-
-                        do_parallel_multiply<T, T>(*result, *lhs, *rhs);
-
-                        // lock ON
-                        locke.lock();
-                        sizes.erase(one_size);
-                        sizes.erase(two_size);
-                        *news = result->get_width();
-                        busy.erase(one_busy);
-                        busy.erase(two_busy);
-                        *newb = false;
-                        matrices.erase(lhs);
-                        matrices.erase(rhs);
-                        locke.unlock();
-                        // lock OFF
-                    }));
-                    }catch(...){ handle_exception(); }
-                }
-            }
-            lock.unlock();
-            for(auto& t : threads) {t.join();}
-            threads.clear();
-            found = true;
+    template<class result_type>
+    void multiply(const matrix_ref<T,result_type>& result, const matrix_wrap<T>& lhs, const matrix_wrap<T>& rhs) const {
+        if(strassen_cutoff) strassen_multiply(result, lhs, rhs, strassen_cutoff);
+        else do_parallel_multiply<T,T>(result, lhs, rhs);
+    }
+
+    // a sub-product the plan needs more than once, held until its last use
+    struct shared_product {
+        std::unique_ptr<matrix_ref<T,Plain>> value;
+        unsigned uses;
+    };
+
+    // a chain ready for evaluation: its plan, within the room left under the
+    // limit on temporaries, and every sub-product occurring more than once in
+    // the plan, keyed by the ids of its factors
+    struct chain_evaluation {
+        explicit chain_evaluation(const std::vector<matrix_wrap<T>>& chain) :
+                factors(chain), ids(operand_ids(chain)),
+                plan(chain_dims(chain), sizeof(T), ids, temporary_pool::instance().headroom()),
+                guard(std::make_unique<std::mutex>()) {}
+
+        std::vector<unsigned> key(unsigned i, unsigned j) const {
+            return std::vector<unsigned>(ids.begin()+i, ids.begin()+j+1);
         }
+
+        // a use of the shared product of chain[i..j], nullptr if there is none
+        // left. The last use planned takes the evaluation's reference with it,
+        // so the product is freed as soon as it is consumed.
+        std::unique_ptr<matrix_wrap<T>> take(unsigned i, unsigned j) const {
+            std::lock_guard<std::mutex> lock(*guard);
+            const auto found = shared.find(key(i, j));
+            if(found == shared.end() || !found->second.value) return nullptr;
+            auto use = std::make_unique<matrix_wrap<T>>(*found->second.value);
+            if(--found->second.uses == 0) found->second.value.reset();
+            return use;
+        }
+
+        std::vector<matrix_wrap<T>> factors;
+        std::vector<unsigned> ids;
+        chain_plan plan;
+        mutable std::map<std::vector<unsigned>, shared_product> shared;
+        std::unique_ptr<std::mutex> guard;
+    };
+
+    // plans the chain and computes, once each and smallest first, the
+    // sub-products that its plan needs more than once
+    chain_evaluation prepare(const std::vector<matrix_wrap<T>>& chain) const {
+        chain_evaluation ev(chain);
+        std::map<std::vector<unsigned>, std::pair<unsigned,unsigned>> seen;
+        std::vector<std::pair<unsigned,unsigned>> repeated;
+        count_subchains(ev, 0, chain.size()-1, seen, repeated);
+        std::sort(repeated.begin(), repeated.end(), [](const auto& a, const auto& b) {
+            return a.second-a.first < b.second-b.first;
+        });
+        for(const auto& sub : repeated) {
+            const std::vector<unsigned> key = ev.key(sub.first, sub.second);
+            auto value = std::make_unique<matrix_ref<T,Plain>>(compute(ev, sub.first, sub.second));
+            ev.shared.emplace(key, shared_product{std::move(value), seen[key].first});
+        }
+        return ev;
     }
 
-	typename std::list<matrix_wrap<T>>::iterator find_max(int *pos) {
-		typename std::list<matrix_wrap<T>>::iterator mat_iter=matrices.begin();
-		typename std::list<matrix_wrap<T>>::iterator mat_max=mat_iter;
-		std::list<unsigned>::iterator size_iter=sizes.begin();
-		std::list<unsigned>::iterator last=--(sizes.end());
-        std::list<bool>::iterator busy_iter = busy.begin();
-		unsigned size_max=*size_iter;
-        unsigned act_pos = 0;
-        if(!(*busy_iter) && !(*std::next(busy_iter))) {
-            *pos = 0;
-        }else{
-            size_max = 0;
+    // walks the plan tree; a sub-chain met a second time is not walked again
+    void count_subchains(const chain_evaluation& ev, unsigned i, unsigned j,
+                         std::map<std::vector<unsigned>, std::pair<unsigned,unsigned>>& seen,
+                         std::vector<std::pair<unsigned,unsigned>>& repeated) const {
+        if(i==j) return;
+        auto found = seen.emplace(ev.key(i, j), std::make_pair(0u, 0u)).first;
+        if(found->second.first++ != 0) {
+            if(found->second.first == 2) repeated.emplace_back(i, j);
+            return;
         }
+        const unsigned k = ev.plan.split(i, j);
+        count_subchains(ev, i, k, seen, repeated);
+        count_subchains(ev, k+1, j, seen, repeated);
+    }
 
-		while (size_iter!=last) {
-			if(*size_iter > size_max && !(*busy_iter) && !(*std::next(busy_iter))){
-				size_max = *size_iter;
-				mat_max = mat_iter;
-                *pos = act_pos;
-			}
-			++mat_iter;
-			++size_iter;
-            ++busy_iter;
-            ++act_pos;
-		}
-
-		return mat_max;
-	}
+    // result = the whole chain, evaluated in the order of its optimal plan.
+    // With the result cache on, the product is stored there and copied out.
+    template<class result_type>
+    void evaluate(const matrix_ref<T,result_type>& result) const {
+        if(!result_cache<T>::instance().enabled())
+            return evaluate(prepare(matrices), 0, matrices.size()-1, result);
+        do_sum<T>(result, {matrix_wrap<T>(compute(prepare(matrices), 0, matrices.size()-1))});
+    }
+
+    typedef std::pair<std::unique_ptr<matrix_wrap<T>>, std::unique_ptr<matrix_wrap<T>>> operand_pair;
+
+    // the two halves of the best split of chain[i..j], computed concurrently
+    // unless that would pass the limit on temporaries
+    operand_pair halves(const chain_evaluation& chain, unsigned i, unsigned j) const {
+        const chain_plan& plan = chain.plan;
+        const unsigned k = plan.split(i, j);
+        operand_pair ops;
+        budgeted_fork_join(plan.peak(i,k), plan.kept(i,k), plan.peak(k+1,j), plan.kept(k+1,j),
+                           [&] { ops.first = operand(chain, i, k); },
+                           [&] { ops.second = operand(chain, k+1, j); });
+        return ops;
+    }
+
+    // result = chain[i] * ... * chain[j]
+    template<class result_type>
+    void evaluate(const chain_evaluation& chain, unsigned i, unsigned j,
+                  const matrix_ref<T,result_type>& result) const {
+        const operand_pair ops = halves(chain, i, j);
+        multiply(result, *ops.first, *ops.second);
+    }
+
+    std::unique_ptr<matrix_wrap<T>> operand(const chain_evaluation& chain, unsigned i, unsigned j) const {
+        if(i==j) return std::make_unique<matrix_wrap<T>>(chain.factors[i]);
+        if(std::unique_ptr<matrix_wrap<T>> use = chain.take(i, j)) return use;
+        return std::make_unique<matrix_wrap<T>>(compute(chain, i, j));
+    }
+
+    // chain[i] * ... * chain[j] in a new matrix, or shared from the result cache.
+    // The matrix is allocated only once both halves are ready, and the halves
+    // are released right after the multiplication: the block of an
+    // intermediate nothing else holds goes back to the pool and becomes the
+    // destination of a later step, instead of every level being held at once.
+    matrix_ref<T,Plain> compute(const chain_evaluation& chain, unsigned i, unsigned j) const {
+        result_cache<T>& cache = result_cache<T>::instance();
+        const typename result_cache<T>::key_type key(chain.factors.begin()+i, chain.factors.begin()+j+1,
+                                                     strassen_cutoff);
+        const bool cached = cache.enabled() && key.valid();
+        if(cached)
+            if(std::unique_ptr<matrix<T>> hit = cache.find(key)) return *hit;
+        operand_pair ops = halves(chain, i, j);
+        matrix<T> product(chain.factors[i].get_height(), chain.factors[j].get_width(), pool_allocator<char>(), matrix_init::uninitialized);
+        multiply(product, *ops.first, *ops.second);
+        ops = operand_pair();
+        if(cached) cache.insert(key, product);
+        return product;
+    }
 
-	std::list<matrix_wrap<T>> matrices;
-	std::list<unsigned> sizes;
-    std::list<bool> busy;
+	std::vector<matrix_wrap<T>> matrices;
+    unsigned strassen_cutoff = 0;
 };
 
 
-template<typename T, unsigned h, unsigned w>
-void force_multiplication(matrix_product<T,h,w>&& prod, std::promise<matrix<T>> promise){
-    prod.resolve();
-    matrix_wrap<T> lhs = prod.matrices.front(), rhs = prod.matrices.back();
-    const unsigned height = lhs.get_height();
-    const unsigned width = rhs.get_width();
-    const unsigned span = lhs.get_width();
-    assert(span == rhs.get_height());
-    matrix<T> result(height, width);
-    try{ do_parallel_multiply<T,T>(result, lhs, rhs); }
-    catch(...){ handle_exception(); }
-    promise.set_value(result);
-}
+// product chain of Sized operands: every dimension is part of the type, so the
+// evaluation order is planned at compile time and unrolled into a fixed tree of
+// calls. Converts and combines with other expressions as a matrix_product.
+template<typename T, unsigned... dims>
+class sized_product : public matrix_product<T, static_chain_plan<sizeof(T), dims...>::dim(0),
+                                            static_chain_plan<sizeof(T), dims...>::dim(sizeof...(dims)-1)> {
+    typedef static_chain_plan<sizeof(T), dims...> plan;
 
-template<typename T, unsigned h, unsigned w>
-void force_mult_stat(matrix_product<T,h,w>&& prod, std::promise<matrix<T,h,w>> promise){
-    prod.resolve();
-    matrix_wrap<T> lhs = prod.matrices.front(), rhs = prod.matrices.back();
-    const unsigned height = lhs.get_height();
-    const unsigned width = rhs.get_width();
-    const unsigned span = lhs.get_width();
-    assert(span == rhs.get_height());
-    matrix<T,h,w> result;
-    for (unsigned i=0; i!=height; ++i)
-        for (unsigned j=0; j!=width; ++j) {
-            result(i,j) = 0;
-            for (unsigned k=0; k!=span; ++k)
-                result(i,j) += lhs(i,k)*rhs(k,j);
+	public:
+
+	operator matrix<T>() {
+		matrix<T> result(plan::dim(0), plan::dim(plan::size()), matrix_init::uninitialized);
+        try{ evaluate(result); }
+        catch(...) { handle_exception(); }
+		std::cerr << "product conversion\n";
+		return result;
+	}
+
+	template<unsigned h2, unsigned w2>
+	operator matrix<T,h2,w2>() {
+		static_assert(h2==plan::dim(0) && w2==plan::dim(plan::size()), "sized product conversion to wrong sized matrix");
+		matrix<T,h2,w2> result(matrix_init::uninitialized);
+		try{ evaluate(result); }
+        catch(...) { handle_exception(); }
+		std::cerr << "sized product conversion\n";
+		return result;
+	}
+
+    sized_product<T,dims...> strassen(unsigned cutoff=strassen_default_cutoff) && {
+        this->strassen_cutoff = cutoff;
+        return std::move(*this);
+    }
+
+    template<typename Z, typename U, class LType, class RType>
+    friend std::enable_if_t<std::is_same<Z,U>::value && is_sized<Z,LType>() && is_sized<U,RType>(),
+            sized_product<Z, matrix_ref<Z,LType>::H, matrix_ref<Z,LType>::W, matrix_ref<U,RType>::W>>
+    operator * (const matrix_ref<Z,LType>& lhs, const matrix_ref<U,RType>& rhs);
+
+    template<typename Z, unsigned... dims2, typename U, class RType>
+    friend std::enable_if_t<std::is_same<Z,U>::value && is_sized<U,RType>(),
+            sized_product<Z, dims2..., matrix_ref<U,RType>::W>>
+    operator * (sized_product<Z,dims2...>&& lhs, const matrix_ref<U,RType>& rhs);
+
+    sized_product(sized_product<T,dims...>&& X) = default;
+
+	private:
+
+    sized_product()=default;
+
+    template<unsigned... dims2>
+    sized_product(sized_product<T,dims2...>&& X) {
+        this->matrices = X.get_mats();
+        this->strassen_cutoff = X.get_strassen_cutoff();
+    }
+
+    typedef matrix_product<T, plan::dim(0), plan::dim(plan::size())> base;
+    typedef std::array<gemm_view<T>, plan::size()> factor_views;
+
+    // matrices[i] * ... * matrices[j]
+    template<unsigned i, unsigned j>
+    using part = matrix<T, plan::dim(i), plan::dim(j+1)>;
+
+    // products of fewer flops are left to loops of constant trip counts: the
+    // packing of the kernel would cost more than the product itself
+    static constexpr double loop_cost = 1<<16;
+
+    template<class result_type>
+    void evaluate(const matrix_ref<T,result_type>& result) const {
+        // the Strassen recursion runs on windows of plain matrices anyway
+        if(this->strassen_cutoff) return base::evaluate(result);
+        // every factor is looked up once, then read straight from its storage;
+        // one that cannot be addressed (e.g. a Diagonal_matrix) is copied out
+        std::array<std::vector<T>, plan::size()> copies;
+        factor_views factors;
+        for(unsigned i=0; i!=plan::size(); ++i) {
+            const unsigned height = plan::dim(i), width = plan::dim(i+1);
+            const matrix_wrap<T>& factor = this->matrices[i];
+            raw_view<T> view = factor.get_raw();
+            if(!view.data) {
+                copies[i] = factor.get_sub(0, height, 0, width);
+                view = {copies[i].data(), width, 1};
+            }
+            factors[i] = {view, height, width};
+        }
+        evaluate<0, plan::size()-1>(factors, [&]() -> const matrix_ref<T,result_type>& { return result; });
+    }
+
+    // matrices[i] * ... * matrices[j], split where the plan says, into the
+    // matrix returned by destination. It is only asked for once both halves
+    // are ready, so a temporary destination can reuse the blocks of the ones
+    // consumed below it. Halves worth a thread of their own are computed
+    // concurrently, within the limit on temporaries.
+    template<unsigned i, unsigned j, class F>
+    decltype(auto) evaluate(const factor_views& factors, F&& destination) const {
+        constexpr unsigned k = plan::split(i, j);
+        return evaluate<i,k,j>(factors, destination, std::integral_constant<bool,
+                plan::cost(i,k) >= chain_fork_cost && plan::cost(k+1,j) >= chain_fork_cost>());
+    }
+
+    template<unsigned i, unsigned k, unsigned j, class F>
+    decltype(auto) evaluate(const factor_views& factors, F& destination, std::false_type) const {
+        const auto& lhs = operand<i,k>(factors);
+        const auto& rhs = operand<k+1,j>(factors);
+        decltype(auto) result = destination();
+        multiply<plan::dim(i), plan::dim(k+1), plan::dim(j+1)>(get_raw_view(result), view(lhs), view(rhs));
+        return result;
+    }
+
+    // both halves are products here: a single factor costs nothing
+    template<unsigned i, unsigned k, unsigned j, class F>
+    decltype(auto) evaluate(const factor_views& factors, F& destination, std::true_type) const {
+        std::unique_ptr<part<i,k>> lhs;
+        std::unique_ptr<part<k+1,j>> rhs;
+        budgeted_fork_join(plan::peak(i,k), plan::kept(i,k), plan::peak(k+1,j), plan::kept(k+1,j),
+                           [&] { lhs = std::make_unique<part<i,k>>(operand<i,k>(factors)); },
+                           [&] { rhs = std::make_unique<part<k+1,j>>(operand<k+1,j>(factors)); });
+        decltype(auto) result = destination();
+        multiply<plan::dim(i), plan::dim(k+1), plan::dim(j+1)>(get_raw_view(result), view(*lhs), view(*rhs));
+        return result;
+    }
+
+    template<unsigned i, unsigned j>
+    static std::enable_if_t<i==j, const gemm_view<T>&> operand(const factor_views& factors) { return factors[i]; }
+
+    // temporaries large enough to be worth a thread come from the pool, and
+    // count against its limit; the small ones are not worth its lock
+    template<unsigned i, unsigned j>
+    std::enable_if_t<i!=j, part<i,j>> operand(const factor_views& factors) const {
+        return evaluate<i,j>(factors, [] {
+            return plan::cost(i,j) >= chain_fork_cost
+                   ? part<i,j>(std::allocator_arg, pool_allocator<char>(), matrix_init::uninitialized)
+                   : part<i,j>(matrix_init::uninitialized);
+        });
+    }
+
+    static const gemm_view<T>& view(const gemm_view<T>& factor) { return factor; }
+    template<unsigned h, unsigned w>
+    static gemm_view<T> view(const matrix<T,h,w>& temporary) { return {get_raw_view(temporary), h, w}; }
+
+    // c = lhs*rhs, an h x s by an s x w product
+    template<unsigned h, unsigned s, unsigned w>
+    static void multiply(raw_view<T> c, const gemm_view<T>& lhs, const gemm_view<T>& rhs) {
+        if(2.0*h*s*w >= loop_cost) return gemm_multiply(c, h, w, lhs, rhs);
+        const raw_view<T> a = lhs.view, b = rhs.view;
+        for(unsigned i=0; i!=h; ++i) {
+            T* row = c.data + i*c.row_step;
+            std::fill(row, row+w, T(0));
+            for(unsigned k=0; k!=s; ++k) {
+                const T x = a.data[i*a.row_step + k*a.col_step];
+                for(unsigned j=0; j!=w; ++j) row[j] += x*b.data[k*b.row_step + j*b.col_step];
+            }
         }
-    promise.set_value(result);
+    }
 };
 
 
+// evaluates prod into result, already of the right size
+template<typename T, unsigned h, unsigned w, class result_type>
+void force_multiplication(matrix_product<T,h,w>&& prod, const matrix_ref<T,result_type>& result){
+    // written through its raw view: detached from copies and versioned
+    prepare_write(result);
+    try{ prod.evaluate(result); }
+    catch(...){ handle_exception(); }
+}
+
+
 
 
 // ***** Multiplication operators ******* //
@@ -581,7 +1011,7 @@ void force_mult_stat(matrix_product<T,h,w>&& prod, std::promise<matrix<T,h,w>> p
 
 // mat * mat [same type]
 template<typename T, typename U, class LType, class RType>
-std::enable_if_t<std::is_same<T,U>::value,
+std::enable_if_t<std::is_same<T,U>::value && !(is_sized<T,LType>() && is_sized<U,RType>()),
         matrix_product<T, matrix_ref<T,LType>::H, matrix_ref<U,RType>::W>>
 operator * (const matrix_ref<T,LType>& lhs, const matrix_ref<U,RType>& rhs) {
     static_assert( (matrix_ref<T,LType>::H==0||matrix_ref<U,RType>::W==0) || matrix_ref<T,LType>::W==matrix_ref<U,RType>::H,
@@ -594,6 +1024,19 @@ operator * (const matrix_ref<T,LType>& lhs, const matrix_ref<U,RType>& rhs) {
     return result;
 }
 
+// stat * stat [same type]
+template<typename T, typename U, class LType, class RType>
+std::enable_if_t<std::is_same<T,U>::value && is_sized<T,LType>() && is_sized<U,RType>(),
+        sized_product<T, matrix_ref<T,LType>::H, matrix_ref<T,LType>::W, matrix_ref<U,RType>::W>>
+operator * (const matrix_ref<T,LType>& lhs, const matrix_ref<U,RType>& rhs) {
+    static_assert(matrix_ref<T,LType>::W==matrix_ref<U,RType>::H,
+                  "dimension mismatch in Matrix multiplication");
+    sized_product<T, matrix_ref<T,LType>::H, matrix_ref<T,LType>::W, matrix_ref<U,RType>::W> result;
+    result.add(lhs);
+    result.add(rhs);
+    return result;
+}
+
 
 // dyno * dyno [not same type]
 template<typename T, class LType, typename U, class RType>
@@ -604,7 +1047,7 @@ operator * (const matrix_ref<T,LType>& lhs, const matrix_ref<U,RType>& rhs){
         throw std::domain_error("dimension mismatch in Matrix multiplication");
     const unsigned height = lhs.get_height();
     const unsigned width = rhs.get_width();
-    matrix<typename op_traits<T,U>::prod_type> result(height,width);
+    matrix<typename op_traits<T,U>::prod_type> result(height,width, matrix_init::uninitialized);
     try{ do_parallel_multiply<T,U>(result, lhs, rhs); }
     catch(...) { handle_exception(); }
     return result;
@@ -639,6 +1082,18 @@ operator * (matrix_product<T,h,w>&& lhs, const matrix_ref<U,RType>& rhs){
     return result;
 };
 
+// sized_mult * stat [same type]
+template<typename T, unsigned... dims, typename U, class RType>
+std::enable_if_t<std::is_same<T,U>::value && is_sized<U,RType>(),
+        sized_product<T, dims..., matrix_ref<U,RType>::W>>
+operator * (sized_product<T,dims...>&& lhs, const matrix_ref<U,RType>& rhs){
+    static_assert(sized_product<T,dims...>::W==matrix_ref<U,RType>::H,
+                  "dimension mismatch in Matrix multiplication");
+    sized_product<T, dims..., matrix_ref<U,RType>::W> result(std::move(lhs));
+    result.add(rhs);
+    return result;
+}
+
 // mat_mult * dyno [not same type]
 template<typename T, unsigned h, unsigned w, typename U, class RType>
 std::enable_if_t<!std::is_same<T,U>::value && w*h*matrix_ref<U,RType>::H==0,
@@ -649,7 +1104,7 @@ operator * (matrix_product<T,h,w>&& lhs, const matrix_ref<U,RType>& rhs){
     const unsigned height = lhs.get_height();
     const unsigned width = rhs.get_width();
     matrix<T> left = lhs;
-    matrix<typename op_traits<T,U>::prod_type> result(height,width);
+    matrix<typename op_traits<T,U>::prod_type> result(height,width, matrix_init::uninitialized);
     try{ do_parallel_multiply<T,U>(result, left, rhs); }
     catch(...) { handle_exception(); }
     return result;
@@ -680,19 +1135,22 @@ operator * (matrix_addition<T,h,w>&& lhs, matrix_addition<U,h2,w2>&& rhs){
                   "dimension mismatch in Matrix multiplication");
     if (lhs.get_width()!=rhs.get_height())
         throw std::domain_error("dimension mismatch in Matrix multiplication");
-    std::promise<matrix<T>> lhs_promise;
-    std::promise<matrix<U>> rhs_promise;
-    auto lhs_future = lhs_promise.get_future();
-    auto rhs_future = rhs_promise.get_future();
+    matrix<T> left(lhs.get_height(), lhs.get_width(), pool_allocator<char>(), matrix_init::uninitialized);
     matrix_product<T, h, w2> result;
+    if (same_operands(lhs.get_mats(), rhs.get_mats())) {
+        // both sides are the same sum: evaluated once
+        force_addition(std::move(lhs), left);
+        result.add(left);
+        result.add(left);
+        return result;
+    }
+    matrix<U> right(rhs.get_height(), rhs.get_width(), pool_allocator<char>(), matrix_init::uninitialized);
     try {
-        std::thread th1(force_addition<T, h, w>, std::move(lhs), std::move(lhs_promise));
-        std::thread th2(force_addition<U, h2, w2>, std::move(rhs), std::move(rhs_promise));
-        result.add(lhs_future.get());
-        result.add(rhs_future.get());
-        th1.join();
-        th2.join();
+        task_group::fork_join([&] { force_addition(std::move(lhs), left); },
+                              [&] { force_addition(std::move(rhs), right); });
     }catch(...) { handle_exception(); }
+    result.add(left);
+    result.add(right);
     return result;
 };
 
@@ -701,17 +1159,13 @@ template<typename T, unsigned h, unsigned w, typename U, unsigned h2, unsigned w
 std::enable_if_t<!std::is_same<T,U>::value && h*w*h2*w2!=0, matrix<typename op_traits<T,U>::prod_type,h,w2>>
 operator * (matrix_addition<T,h,w>&& lhs, matrix_addition<U,h2,w2>&& rhs){
     static_assert(w==h2, "dimension mismatch in Matrix multiplication");
-    std::promise<matrix<T>> lhs_promise;
-    std::promise<matrix<U>> rhs_promise;
-    auto lhs_future = lhs_promise.get_future();
-    auto rhs_future = rhs_promise.get_future();
+    matrix<T> left(lhs.get_height(), lhs.get_width(), pool_allocator<char>(), matrix_init::uninitialized);
+    matrix<U> right(rhs.get_height(), rhs.get_width(), pool_allocator<char>(), matrix_init::uninitialized);
     matrix<typename op_traits<T,U>::prod_type,h,w2> result;
     try {
-        std::thread th1(force_addition<T, h, w>, std::move(lhs), std::move(lhs_promise));
-        std::thread th2(force_addition<U, h2, w2>, std::move(rhs), std::move(rhs_promise));
-        do_parallel_multiply<T, U>(result, std::move(lhs_future.get()), std::move(rhs_future.get()));
-        th1.join();
-        th2.join();
+        task_group::fork_join([&] { force_addition(std::move(lhs), left); },
+                              [&] { force_addition(std::move(rhs), right); });
+        do_parallel_multiply<T, U>(result, left, right);
     }catch(...) { handle_exception(); }
     return result;
 };
@@ -724,17 +1178,13 @@ operator * (matrix_addition<T,h,w>&& lhs, matrix_addition<U,h2,w2>&& rhs) {
         throw std::domain_error("dimension mismatch in Matrix multiplication");
     const unsigned height = lhs.get_height();
     const unsigned width = rhs.get_width();
-    std::promise<matrix<T>> lhs_promise;
-    std::promise<matrix<U>> rhs_promise;
-    auto lhs_future = lhs_promise.get_future();
-    auto rhs_future = rhs_promise.get_future();
-    matrix<typename op_traits<T,U>::prod_type> result(height,width);
+    matrix<T> left(height, lhs.get_width(), pool_allocator<char>(), matrix_init::uninitialized);
+    matrix<U> right(rhs.get_height(), width, pool_allocator<char>(), matrix_init::uninitialized);
+    matrix<typename op_traits<T,U>::prod_type> result(height,width, matrix_init::uninitialized);
     try {
-        std::thread th1(force_addition<T, h, w>, std::move(lhs), std::move(lhs_promise));
-        std::thread th2(force_addition<U, h2, w2>, std::move(rhs), std::move(rhs_promise));
-        do_parallel_multiply<T, U>(result, std::move(lhs_future.get()), std::move(rhs_future.get()));
-        th1.join();
-        th2.join();
+        task_group::fork_join([&] { force_addition(std::move(lhs), left); },
+                              [&] { force_addition(std::move(rhs), right); });
+        do_parallel_multiply<T, U>(result, left, right);
     }catch(...) { handle_exception(); }
     return result;
 }
@@ -743,19 +1193,23 @@ operator * (matrix_addition<T,h,w>&& lhs, matrix_addition<U,h2,w2>&& rhs) {
 template<typename T, unsigned h, unsigned w, typename U, unsigned h2, unsigned w2>
 std::enable_if_t<std::is_same<T,U>::value, matrix_addition<T,h,w2>>
 operator + (matrix_product<T,h,w>&& lhs, matrix_product<U,h2,w2>&& rhs){
-    std::promise<matrix<T>> lhs_promise;
-    std::promise<matrix<T>> rhs_promise;
-    auto lhs_future = lhs_promise.get_future();
-    auto rhs_future = rhs_promise.get_future();
+    matrix<T> left(lhs.get_height(), lhs.get_width(), pool_allocator<char>(), matrix_init::uninitialized);
     matrix_addition<T,h,w2> result;
+    if (same_operands(lhs.get_mats(), rhs.get_mats())) {
+        // both sides are the same product: evaluated once
+        force_multiplication(std::move(lhs), left);
+        result.add(left);
+        result.add(left);
+        return result;
+    }
+    matrix<T> right(rhs.get_height(), rhs.get_width(), pool_allocator<char>(), matrix_init::uninitialized);
     try {
-        std::thread th1(force_multiplication<T, h, w>, std::move(lhs), std::move(lhs_promise));
-        std::thread th2(force_multiplication<T, h2, w2>, std::move(rhs), std::move(rhs_promise));
-        result.add(lhs_future.get());
-        result.add(rhs_future.get());
-        th1.join();
-        th2.join();
+        budgeted_fork_join(lhs.get_temporary_bytes(), 0.0, rhs.get_temporary_bytes(), 0.0,
+                           [&] { force_multiplication(std::move(lhs), left); },
+                           [&] { force_multiplication(std::move(rhs), right); });
     }catch(...) { handle_exception(); }
+    result.add(left);
+    result.add(right);
     return result;
 };
 
@@ -767,20 +1221,14 @@ operator + (matrix_product<T,h,w>&& lhs, matrix_product<U,h2,w2>&& rhs){
         throw std::domain_error("dimension mismatch in Matrix addition");
     const unsigned height = lhs.get_height();
     const unsigned width = rhs.get_width();
-    std::promise<matrix<T>> lhs_promise;
-    std::promise<matrix<U>> rhs_promise;
-    auto lhs_future = lhs_promise.get_future();
-    auto rhs_future = rhs_promise.get_future();
-    matrix<T> left;
-    matrix<U> right;
+    matrix<T> left(height, width, pool_allocator<char>(), matrix_init::uninitialized);
+    matrix<U> right(height, width, pool_allocator<char>(), matrix_init::uninitialized);
     try {
-        std::thread th1(force_multiplication<T, h, w>, std::move(lhs), std::move(lhs_promise));
-        std::thread th2(force_multiplication<U, h2, w2>, std::move(rhs), std::move(rhs_promise));
-        left = lhs_future.get();
-        right = rhs_future.get();
-        th1.join(); th2.join();
+        budgeted_fork_join(lhs.get_temporary_bytes(), 0.0, rhs.get_temporary_bytes(), 0.0,
+                           [&] { force_multiplication(std::move(lhs), left); },
+                           [&] { force_multiplication(std::move(rhs), right); });
     }catch(...) { handle_exception(); }
-    matrix<typename op_traits<T,U>::prod_type> result(height,width);
+    matrix<typename op_traits<T,U>::prod_type> result(height,width, matrix_init::uninitialized);
     for(unsigned i=0; i!=height; ++i)
         for(unsigned j=0; j!=width; ++j)
             result(i,j) = left(i,j) + right(i,j);
@@ -795,17 +1243,12 @@ operator + (matrix_product<T,h,w>&& lhs, matrix_product<U,h2,w2>&& rhs) {
     static_assert(h==h2 && w==w2, "dimension mismatch in Matrix addition");
     const unsigned height = lhs.get_height();
     const unsigned width = rhs.get_width();
-    std::promise<matrix<T,h,w>> lhs_promise;
-    std::promise<matrix<U,h2,w2>> rhs_promise;
-    auto lhs_future = lhs_promise.get_future();
-    auto rhs_future = rhs_promise.get_future();
     matrix<T,h,w> left;
     matrix<U,h2,w2> right;
     try {
-        std::thread th1(force_mult_stat<T, h, w>, std::move(lhs), std::move(lhs_promise));
-        std::thread th2(force_mult_stat<U, h2, w2>, std::move(rhs), std::move(rhs_promise));
-        left = lhs_future.get();
-        right = rhs_future.get();
+        budgeted_fork_join(lhs.get_temporary_bytes(), 0.0, rhs.get_temporary_bytes(), 0.0,
+                           [&] { force_multiplication(std::move(lhs), left); },
+                           [&] { force_multiplication(std::move(rhs), right); });
     }catch(...) { handle_exception(); }
     matrix<typename op_traits<T,U>::prod_type,h,w2> result;
     for(unsigned i=0; i!=height; ++i)
@@ -823,15 +1266,11 @@ operator * (matrix_addition<T,h,w>&& lhs, const matrix_ref<U,RType>& rhs){
                   "dimension mismatch in Matrix multiplication");
     if(lhs.get_width()!=rhs.get_height())
         throw std::domain_error("dimension mismatch in Matrix multiplication");
-    std::promise<matrix<T>> lhs_promise;
-    auto lhs_future = lhs_promise.get_future();
+    matrix<T> left(lhs.get_height(), lhs.get_width(), pool_allocator<char>(), matrix_init::uninitialized);
     matrix_product<T,h,matrix_ref<U,RType>::W> result;
-    try {
-        std::thread th(force_addition<T, h, w>, std::move(lhs), std::move(lhs_promise));
-        result.add(lhs_future.get());
-        result.add(rhs);
-        th.join();
-    }catch(...) { handle_exception(); }
+    force_addition(std::move(lhs), left);
+    result.add(left);
+    result.add(rhs);
     return result;
 };
 //mirror: mat * mat_add [same type] ok
@@ -842,15 +1281,11 @@ operator * (const matrix_ref<U,RType>& lhs, matrix_addition<T,h,w>&& rhs){
                   "dimension mismatch in Matrix multiplication");
     if(lhs.get_width()!=rhs.get_height())
         throw std::domain_error("dimension mismatch in Matrix multiplication");
-    std::promise<matrix<T>> rhs_promise;
-    auto rhs_future = rhs_promise.get_future();
+    matrix<T> right(rhs.get_height(), rhs.get_width(), pool_allocator<char>(), matrix_init::uninitialized);
     matrix_product<T,matrix_ref<U,RType>::H,w> result;
-    try {
-        std::thread th(force_addition<T, h, w>, std::move(rhs), std::move(rhs_promise));
-        result.add(lhs);
-        result.add(rhs_future.get());
-        th.join();
-    }catch(...) { handle_exception(); }
+    force_addition(std::move(rhs), right);
+    result.add(lhs);
+    result.add(right);
     return result;
 };
 
@@ -889,7 +1324,7 @@ operator * (matrix_addition<T,h,w>&& lhs, const matrix_ref<U,RType>& rhs){
     if(lhs.get_width()!=rhs.get_height())
         throw std::domain_error("dimension mismatch in Matrix multiplication");
     matrix<T> left = lhs;
-    matrix<typename op_traits<T,U>::prod_type> result(height, width);
+    matrix<typename op_traits<T,U>::prod_type> result(height, width, matrix_init::uninitialized);
     try{ do_parallel_multiply<T,U>(result, left, rhs); }
     catch(...){ handle_exception(); }
     return result;
@@ -904,7 +1339,7 @@ operator * (const matrix_ref<U,RType>& lhs, matrix_addition<T,h,w>&& rhs){
     if(lhs.get_width()!=rhs.get_height())
         throw std::domain_error("dimension mismatch in Matrix multiplication");
     matrix<T> right = rhs;
-    matrix<typename op_traits<U,T>::prod_type> result(height, width);
+    matrix<typename op_traits<U,T>::prod_type> result(height, width, matrix_init::uninitialized);
     try{ do_parallel_multiply<U,T>(result, lhs, right); }
     catch(...){ handle_exception(); }
     return result;
@@ -983,7 +1418,7 @@ operator + (matrix_product<T,h,w>&& lhs, const matrix_ref<U,RType>& rhs){
     const unsigned height = lhs.get_height();
     const unsigned width = rhs.get_width();
     matrix<T> left = lhs;
-    matrix<typename op_traits<T,U>::sum_type> result(height,width);
+    matrix<typename op_traits<T,U>::sum_type> result(height,width, matrix_init::uninitialized);
     for(unsigned i=0; i!=height; ++i)
         for(unsigned j=0; j!=width; ++j)
             result(i,j) = left(i,j) + rhs(i,j);
@@ -999,7 +1434,7 @@ operator + (const matrix_ref<U,RType>& lhs, matrix_product<T,h,w>&& rhs){
     const unsigned height = lhs.get_height();
     const unsigned width = rhs.get_width();
     matrix<T> right = rhs;
-    matrix<typename op_traits<T,U>::sum_type> result(height,width);
+    matrix<typename op_traits<T,U>::sum_type> result(height,width, matrix_init::uninitialized);
     for(unsigned i=0; i!=height; ++i)
         for(unsigned j=0; j!=width; ++j)
             result(i,j) = lhs(i,j) + right(i,j);
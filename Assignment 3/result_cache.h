@@ -0,0 +1,192 @@
+#ifndef MATRIXLIB_RESULT_CACHE_H
+#define MATRIXLIB_RESULT_CACHE_H
+
+#include<list>
+#include<map>
+#include<vector>
+#include<mutex>
+#include<memory>
+#include<tuple>
+#include<cstdlib>
+#include<cstddef>
+
+#include"matrix.h"
+#include"matrix_wrap.h"
+
+// an operand as it is at one version of its storage: the buffer, where the
+// view starts in it, how it walks it and its shape
+struct operand_key {
+    const void* buffer;
+    unsigned long version;
+    std::ptrdiff_t offset;
+    unsigned row_step, col_step, height, width;
+
+    bool operator <(const operand_key& X) const {
+        return std::tie(buffer, version, offset, row_step, col_step, height, width)
+               < std::tie(X.buffer, X.version, X.offset, X.row_step, X.col_step, X.height, X.width);
+    }
+};
+
+
+// least recently used cache of evaluated sub-expressions, shared by every
+// evaluation in the process. Entries are keyed by the identity and version of
+// their operands, so writing to an operand makes its entries unreachable, and
+// they are evicted oldest first once their total size exceeds the byte budget.
+// A write through a reference or iterator taken earlier moves no version: an
+// operand that has handed some out, and has not been shared again since, is
+// not cached.
+// Keys do not keep the storage of their operands; the entries of operands
+// that are gone are dropped at the next insertion. Off unless a budget is set, by set_budget or MATRIXLIB_CACHE_BYTES.
+template<typename T>
+class result_cache {
+public:
+    // a sub-expression: the product of its operands, in order
+    class key_type {
+    public:
+        template<class iterator>
+        key_type(iterator first, iterator last, unsigned strassen_cutoff) : cutoff(strassen_cutoff) {
+            for (; first!=last; ++first) {
+                std::shared_ptr<matrix_buffer<T>> buffer = first->get_buffer();
+                const raw_view<T> view = first->get_raw();
+                if (!buffer || !view.data || !buffer->is_shareable()) {
+                    operands.clear();
+                    return;
+                }
+                operands.push_back({buffer.get(), buffer->get_version(), view.data - buffer->data(),
+                                    view.row_step, view.col_step, first->get_height(), first->get_width()});
+                lifetimes.push_back(buffer->get_lifetime());
+            }
+        }
+
+        // false when an operand has no identity, or references to it may be
+        // written: the expression is not cached
+        bool valid() const { return !operands.empty(); }
+
+        bool operator <(const key_type& X) const {
+            return std::tie(cutoff, operands) < std::tie(X.cutoff, X.operands);
+        }
+
+        // false once the storage of an operand is gone: its address may
+        // then be another matrix's
+        bool alive() const {
+            for (const auto& lifetime : lifetimes)
+                if (lifetime.expired()) return false;
+            return true;
+        }
+
+    private:
+        friend class result_cache<T>;
+
+        unsigned cutoff;
+        std::vector<operand_key> operands;
+        std::vector<std::weak_ptr<const void>> lifetimes;
+    };
+
+    static result_cache& instance() {
+        static result_cache cache(default_budget());
+        return cache;
+    }
+
+    // MATRIXLIB_CACHE_BYTES if set, 0 (no caching) otherwise
+    static std::size_t default_budget() {
+        if (const char* env = std::getenv("MATRIXLIB_CACHE_BYTES"))
+            return std::strtoull(env, nullptr, 10);
+        return 0;
+    }
+
+    explicit result_cache(std::size_t budget) : budget(budget) {}
+
+    result_cache(const result_cache&) = delete;
+    result_cache& operator=(const result_cache&) = delete;
+
+    bool enabled() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        return budget != 0;
+    }
+
+    void set_budget(std::size_t bytes) {
+        std::lock_guard<std::mutex> lock(mtx);
+        budget = bytes;
+        shrink();
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mtx);
+        entries.clear();
+        index.clear();
+        bytes = 0;
+    }
+
+    std::size_t get_budget() const { std::lock_guard<std::mutex> lock(mtx); return budget; }
+    std::size_t get_bytes() const { std::lock_guard<std::mutex> lock(mtx); return bytes; }
+    std::size_t get_hits() const { std::lock_guard<std::mutex> lock(mtx); return hits; }
+    std::size_t get_misses() const { std::lock_guard<std::mutex> lock(mtx); return misses; }
+
+    // a copy of the stored result of key, sharing its storage until either
+    // is written; nullptr on a miss
+    std::unique_ptr<matrix<T>> find(const key_type& key) {
+        std::lock_guard<std::mutex> lock(mtx);
+        const auto found = index.find(key);
+        if (found == index.end()) {
+            ++misses;
+            return nullptr;
+        }
+        entry& e = *found->second;
+        if (get_buffer(e.value)->get_version() != e.version || !e.key.alive()) {
+            // an operand is gone, or the result was written to through a hit
+            erase(found->second);
+            ++misses;
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, found->second);
+        ++hits;
+        return std::make_unique<matrix<T>>(e.value);
+    }
+
+    // stores a copy of value: writes to value leave it alone
+    void insert(const key_type& key, const matrix<T>& value) {
+        const std::size_t size = std::size_t(value.get_height())*value.get_width()*sizeof(T);
+        std::lock_guard<std::mutex> lock(mtx);
+        purge();
+        if (size > budget || index.count(key)) return;
+        entries.push_front({key, value, get_buffer(value)->get_version(), size});
+        index.emplace(key, entries.begin());
+        bytes += size;
+        shrink();
+    }
+
+private:
+    struct entry {
+        key_type key;
+        matrix<T> value;
+        unsigned long version;
+        std::size_t size;
+    };
+
+    void erase(typename std::list<entry>::iterator e) {
+        bytes -= e->size;
+        index.erase(e->key);
+        entries.erase(e);
+    }
+
+    // drops the entries of operands that are gone: none of them can be
+    // found again, and their results would hold the budget until evicted
+    void purge() {
+        for (auto e = entries.begin(); e != entries.end();)
+            if (e->key.alive()) ++e;
+            else erase(e++);
+    }
+
+    void shrink() {
+        while (bytes > budget) erase(std::prev(entries.end()));
+    }
+
+    std::size_t budget;
+    std::size_t bytes = 0;
+    std::size_t hits = 0, misses = 0;
+    std::list<entry> entries;
+    std::map<key_type, typename std::list<entry>::iterator> index;
+    mutable std::mutex mtx;
+};
+
+#endif //MATRIXLIB_RESULT_CACHE_H
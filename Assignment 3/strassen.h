@@ -0,0 +1,160 @@
+#ifndef MATRIXLIB_STRASSEN_H
+#define MATRIXLIB_STRASSEN_H
+
+#include<algorithm>
+#include<memory>
+
+#include"matrix.h"
+#include"matrix_wrap.h"
+#include"gemm.h"
+#include"temporary_pool.h"
+
+// Strassen-Winograd product: 7 half-size products and 15 additions per level
+// instead of 8 products. Blocks whose smallest side is at most the cutoff are
+// left to the packed kernel. Integer results are exact; floating point results
+// get the weaker error bound of the fast algorithm, so this is opt-in.
+constexpr unsigned strassen_default_cutoff = 512;
+
+
+// the rows [from_r, to_r) and columns [from_c, to_c) of a block
+template<typename T>
+gemm_view<T> sub_block(const gemm_view<T>& X, unsigned from_r, unsigned to_r, unsigned from_c, unsigned to_c) {
+    const raw_view<T> v = X.view;
+    return {{v.data + from_r*v.row_step + from_c*v.col_step, v.row_step, v.col_step}, to_r-from_r, to_c-from_c};
+}
+
+template<typename T>
+gemm_view<T> quadrant(const gemm_view<T>& X, unsigned row, unsigned col) {
+    const unsigned h = X.height/2, w = X.width/2;
+    return sub_block(X, row*h, (row+1)*h, col*w, (col+1)*w);
+}
+
+template<typename T>
+matrix<T> strassen_temp(unsigned height, unsigned width) {
+    return matrix<T>(height, width, pool_allocator<char>(), matrix_init::uninitialized);
+}
+
+template<typename T>
+gemm_view<T> whole(const matrix<T>& X) {
+    return {get_raw_view(X), X.get_height(), X.get_width()};
+}
+
+// dest = lhs + rhs (or lhs - rhs); dest may be one of the operands
+template<typename T>
+void strassen_combine(const gemm_view<T>& dest, const gemm_view<T>& lhs, const gemm_view<T>& rhs, bool subtract) {
+    const raw_view<T> c = dest.view, a = lhs.view, b = rhs.view;
+    const add_kernel<T> kernel = subtract ? select_sub_kernel<T>() : select_add_kernel<T>();
+    for (unsigned i=0; i!=dest.height; ++i)
+        kernel(c.data + i*c.row_step, a.data + i*a.row_step, b.data + i*b.row_step, dest.width);
+}
+
+template<typename T>
+void strassen_base(const gemm_view<T>& C, const gemm_view<T>& A, const gemm_view<T>& B) {
+    gemm_multiply(C.view, C.height, C.width, A, B);
+}
+
+// C = A*B on blocks whose rows are contiguous. Odd sides are peeled off: the
+// even core goes through the recursion and the leftover row, column and
+// rank-1 term through the packed kernel.
+template<typename T>
+void strassen_step(const gemm_view<T>& C, const gemm_view<T>& A, const gemm_view<T>& B, unsigned cutoff) {
+    const unsigned m = A.height, k = A.width, n = B.width;
+    if (std::min({m, k, n}) <= cutoff) return strassen_base(C, A, B);
+
+    const unsigned m2 = m&~1u, k2 = k&~1u, n2 = n&~1u;
+    if (m2!=m || k2!=k || n2!=n) {
+        strassen_step(sub_block(C,0,m2,0,n2), sub_block(A,0,m2,0,k2), sub_block(B,0,k2,0,n2), cutoff);
+        if (k2!=k) {
+            const raw_view<T> c = C.view, a = A.view, b = B.view;
+            const T* b_row = b.data + k2*b.row_step;
+            for (unsigned i=0; i!=m2; ++i) {
+                const T a_ik = a.data[i*a.row_step + k2];
+                T* c_row = c.data + i*c.row_step;
+                for (unsigned j=0; j!=n2; ++j) c_row[j] += a_ik*b_row[j];
+            }
+        }
+        if (n2!=n) strassen_base(sub_block(C,0,m2,n2,n), sub_block(A,0,m2,0,k), sub_block(B,0,k,n2,n));
+        if (m2!=m) strassen_base(sub_block(C,m2,m,0,n), sub_block(A,m2,m,0,k), B);
+        return;
+    }
+
+    const auto A11 = quadrant(A,0,0), A12 = quadrant(A,0,1), A21 = quadrant(A,1,0), A22 = quadrant(A,1,1);
+    const auto B11 = quadrant(B,0,0), B12 = quadrant(B,0,1), B21 = quadrant(B,1,0), B22 = quadrant(B,1,1);
+    const auto C11 = quadrant(C,0,0), C12 = quadrant(C,0,1), C21 = quadrant(C,1,0), C22 = quadrant(C,1,1);
+    const matrix<T> X_block = strassen_temp<T>(m/2, k/2);
+    const matrix<T> Y_block = strassen_temp<T>(k/2, n/2);
+    const matrix<T> P1_block = strassen_temp<T>(m/2, n/2);
+    const gemm_view<T> X = whole(X_block), Y = whole(Y_block), P1 = whole(P1_block);
+    // schedule of Boyer, Dumas, Pernet and Zhou: the quadrants of C hold the
+    // partial products, so only three temporaries are needed per level
+    strassen_combine(X, A11, A21, true);        // S3 = A11 - A21
+    strassen_combine(Y, B22, B12, true);        // T3 = B22 - B12
+    strassen_step(C21, X, Y, cutoff);           // P7 = S3 T3
+    strassen_combine(X, A21, A22, false);       // S1 = A21 + A22
+    strassen_combine(Y, B12, B11, true);        // T1 = B12 - B11
+    strassen_step(C22, X, Y, cutoff);           // P5 = S1 T1
+    strassen_combine(Y, B22, Y, true);          // T2 = B22 - T1
+    strassen_combine(X, X, A11, true);          // S2 = S1 - A11
+    strassen_step(C12, X, Y, cutoff);           // P6 = S2 T2
+    strassen_combine(X, A12, X, true);          // S4 = A12 - S2
+    strassen_step(C11, X, B22, cutoff);         // P3 = S4 B22
+    strassen_step(P1, A11, B11, cutoff);        // P1 = A11 B11
+    strassen_combine(C12, P1, C12, false);      // U2 = P1 + P6
+    strassen_combine(C21, C12, C21, false);     // U3 = U2 + P7
+    strassen_combine(C12, C12, C22, false);     // U4 = U2 + P5
+    strassen_combine(C22, C21, C22, false);     // U7 = U3 + P5
+    strassen_combine(C12, C12, C11, false);     // U5 = U4 + P3
+    strassen_combine(Y, Y, B21, true);          // T4 = T2 - B21
+    strassen_step(C11, A22, Y, cutoff);         // P4 = A22 T4
+    strassen_combine(C21, C21, C11, true);      // U6 = U3 - P4
+    strassen_step(C11, A12, B21, cutoff);       // P2 = A12 B21
+    strassen_combine(C11, P1, C11, false);      // U1 = P1 + P2
+}
+
+template<typename T>
+matrix<T> strassen_copy(const matrix_wrap<T>& X) {
+    const unsigned height = X.get_height(), width = X.get_width();
+    matrix<T> result(height, width, matrix_init::uninitialized);
+    gemm_operand<T> src(X);
+    const raw_view<T> from = src.block(0, height, 0, width);
+    const raw_view<T> to = get_raw_view(result);
+    for (unsigned i=0; i!=height; ++i)
+        for (unsigned j=0; j!=width; ++j)
+            to.data[i*to.row_step + j] = from.data[i*from.row_step + j*from.col_step];
+    return result;
+}
+
+// an operand whose rows are contiguous in its storage is read in place.
+// The others, and one sharing its storage with the result, are copied once
+template<typename T>
+gemm_view<T> strassen_operand(const matrix_wrap<T>& X, const std::shared_ptr<matrix_buffer<T>>& result,
+                              std::unique_ptr<matrix<T>>& copy) {
+    const raw_view<T> view = X.get_raw();
+    if (view.data && view.col_step==1 && (!result || X.get_buffer()!=result))
+        return {view, X.get_height(), X.get_width()};
+    copy = std::make_unique<matrix<T>>(strassen_copy(X));
+    return whole(*copy);
+}
+
+template<typename T, class result_type>
+void strassen_multiply(const matrix_ref<T,result_type>& result, const matrix_wrap<T>& lhs,
+                       const matrix_wrap<T>& rhs, unsigned cutoff) {
+    const std::shared_ptr<matrix_buffer<T>> storage = get_buffer(result);
+    std::unique_ptr<matrix<T>> lhs_copy, rhs_copy;
+    const gemm_view<T> A = strassen_operand(lhs, storage, lhs_copy), B = strassen_operand(rhs, storage, rhs_copy);
+    const raw_view<T> c = get_raw_view(result);
+    if (c.data && c.col_step==1) return strassen_step(gemm_view<T>{c, A.height, B.width}, A, B, cutoff);
+    // the recursion writes whole rows: a result without them, e.g. a
+    // transpose, gets the product through a temporary
+    const matrix<T> product = strassen_temp<T>(A.height, B.width);
+    const raw_view<T> p = get_raw_view(product);
+    strassen_step(whole(product), A, B, cutoff);
+    matrix_wrap<T> dest = result;
+    for (unsigned i=0; i!=A.height; ++i)
+        for (unsigned j=0; j!=B.width; ++j) {
+            if (c.data) c.data[i*c.row_step + j*c.col_step] = p.data[i*p.row_step + j];
+            else dest(i,j) = p.data[i*p.row_step + j];
+        }
+}
+
+#endif //MATRIXLIB_STRASSEN_H
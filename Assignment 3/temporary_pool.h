@@ -0,0 +1,199 @@
+#ifndef MATRIXLIB_TEMPORARY_POOL_H
+#define MATRIXLIB_TEMPORARY_POOL_H
+
+#include<map>
+#include<vector>
+#include<mutex>
+#include<new>
+#include<algorithm>
+#include<cstdlib>
+#include<cstddef>
+
+#include"huge_pages.h"
+
+// smallest block handed out; sizes above it are rounded up to one of four
+// classes per power of two, so a block is at most 25% larger than asked for
+constexpr std::size_t pool_min_block = 4096;
+
+inline std::size_t pool_size_class(std::size_t bytes) {
+    if (bytes <= pool_min_block) return pool_min_block;
+    unsigned top = 0;
+    while ((bytes-1) >> (top+1)) ++top;
+    const std::size_t step = std::size_t(1) << (top-2);
+    return (bytes + step-1) / step * step;
+}
+
+
+// blocks for the temporaries of an evaluation: intermediate products, the
+// operands of Strassen levels and the like. A released block is kept, up to
+// a byte budget, and handed to the next temporary of its size class, in the
+// same evaluation or a later one, instead of going back to the system and
+// faulting its pages in again. Blocks past the huge page threshold are
+// mapped on huge pages. The budget is MATRIXLIB_POOL_BYTES if set,
+// 256MB otherwise; 0 turns recycling off.
+// The pool also holds the limit on the temporaries of evaluations held at
+// once, MATRIXLIB_EVAL_BYTES if set, none otherwise: evaluations that would
+// pass it run their parts one after the other and plan for a lower peak.
+class temporary_pool {
+public:
+    static temporary_pool& instance() {
+        // never destroyed: cached results may release their blocks during
+        // static destruction
+        static temporary_pool* pool = new temporary_pool(default_budget(), default_limit());
+        return *pool;
+    }
+
+    static std::size_t default_budget() {
+        if (const char* env = std::getenv("MATRIXLIB_POOL_BYTES"))
+            return std::strtoull(env, nullptr, 10);
+        return std::size_t(256) << 20;
+    }
+
+    static std::size_t default_limit() {
+        if (const char* env = std::getenv("MATRIXLIB_EVAL_BYTES"))
+            return std::strtoull(env, nullptr, 10);
+        return 0;
+    }
+
+    explicit temporary_pool(std::size_t budget, std::size_t limit = 0) : budget(budget), limit(limit) {}
+
+    ~temporary_pool() { trim(); }
+
+    temporary_pool(const temporary_pool&) = delete;
+    temporary_pool& operator=(const temporary_pool&) = delete;
+
+    void* allocate(std::size_t bytes) {
+        const std::size_t size = pool_size_class(bytes);
+        void* block = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            auto found = idle.find(size);
+            if (found != idle.end() && !found->second.empty()) {
+                block = found->second.back();
+                found->second.pop_back();
+                idle_bytes -= size;
+                ++reused;
+            }
+            live += size;
+            total += size;
+            peak = std::max(peak, live);
+        }
+        if (!block) {
+            try { block = obtain(size); }
+            catch(...) {
+                std::lock_guard<std::mutex> lock(mtx);
+                live -= size;
+                total -= size;
+                throw;
+            }
+        }
+        return block;
+    }
+
+    void deallocate(void* block, std::size_t bytes) {
+        const std::size_t size = pool_size_class(bytes);
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            live -= size;
+            if (idle_bytes + size <= budget) {
+                idle[size].push_back(block);
+                idle_bytes += size;
+                return;
+            }
+        }
+        release(block, size);
+    }
+
+    // returns every idle block to the system
+    void trim() {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (auto& blocks : idle)
+            for (void* block : blocks.second) release(block, blocks.first);
+        idle.clear();
+        idle_bytes = 0;
+    }
+
+    void set_limit(std::size_t bytes) {
+        std::lock_guard<std::mutex> lock(mtx);
+        limit = bytes;
+    }
+
+    // bytes more that temporaries may take before reaching the limit; 0 when
+    // there is no limit, at least 1 otherwise
+    std::size_t headroom() const {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (limit == 0) return 0;
+        return limit > live ? limit - live : 1;
+    }
+
+    // whether bytes more of temporaries stay within the limit
+    bool admits(double bytes) const {
+        const std::size_t room = headroom();
+        return room == 0 || bytes <= room;
+    }
+
+    void set_budget(std::size_t bytes) {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            budget = bytes;
+            if (idle_bytes <= budget) return;
+        }
+        trim();
+    }
+
+    // bytes held by temporaries now, at most at once since the last
+    // reset_peak, and handed out overall; bytes kept for reuse; allocations
+    // served from kept blocks
+    std::size_t get_live() const { std::lock_guard<std::mutex> lock(mtx); return live; }
+    std::size_t get_peak() const { std::lock_guard<std::mutex> lock(mtx); return peak; }
+    std::size_t get_total() const { std::lock_guard<std::mutex> lock(mtx); return total; }
+    std::size_t get_idle() const { std::lock_guard<std::mutex> lock(mtx); return idle_bytes; }
+    std::size_t get_reused() const { std::lock_guard<std::mutex> lock(mtx); return reused; }
+    std::size_t get_budget() const { std::lock_guard<std::mutex> lock(mtx); return budget; }
+    std::size_t get_limit() const { std::lock_guard<std::mutex> lock(mtx); return limit; }
+
+    void reset_peak() {
+        std::lock_guard<std::mutex> lock(mtx);
+        peak = live;
+    }
+
+private:
+    static void* obtain(std::size_t size) {
+        return use_huge_pages(size) ? allocate_huge(size) : ::operator new(size);
+    }
+
+    static void release(void* block, std::size_t size) {
+        if (use_huge_pages(size)) deallocate_huge(block, size);
+        else ::operator delete(block);
+    }
+
+    std::size_t budget, limit;
+    std::size_t live = 0, peak = 0, total = 0, idle_bytes = 0, reused = 0;
+    std::map<std::size_t, std::vector<void*>> idle;
+    mutable std::mutex mtx;
+};
+
+
+// allocator drawing from temporary_pool, for the storage of temporaries
+template<typename U>
+struct pool_allocator {
+    typedef U value_type;
+
+    pool_allocator() {}
+    template<typename V>
+    pool_allocator(const pool_allocator<V>&) {}
+
+    U* allocate(std::size_t n) {
+        return static_cast<U*>(temporary_pool::instance().allocate(n*sizeof(U)));
+    }
+    void deallocate(U* p, std::size_t n) {
+        temporary_pool::instance().deallocate(p, n*sizeof(U));
+    }
+
+    template<typename V>
+    bool operator ==(const pool_allocator<V>&) const { return true; }
+    template<typename V>
+    bool operator !=(const pool_allocator<V>&) const { return false; }
+};
+
+#endif //MATRIXLIB_TEMPORARY_POOL_H
@@ -0,0 +1,63 @@
+#include<thread>
+#include"check.h"
+
+// plans and evaluations kept within a limit on the bytes of temporaries
+int main() {
+    // unlimited, [0,2] * [3] is cheapest; within a limit below its peak,
+    // a dearer split holding less is taken
+    const std::vector<unsigned> dims = {50, 30, 100, 30, 10};
+    chain_plan fastest(dims, sizeof(double));
+    CHECK(fastest.peak(0, 3) == 10400);
+    chain_plan within(dims, sizeof(double), {}, fastest.peak(0, 3) - 1);
+    CHECK(within.peak(0, 3) < fastest.peak(0, 3));
+    CHECK(within.cost() > fastest.cost());
+    // no split fits a limit of one byte: the one holding least is taken
+    chain_plan lowest(dims, sizeof(double), {}, 1);
+    CHECK(lowest.peak(0, 3) <= within.peak(0, 3));
+
+    // the result of the whole chain is its destination, no temporary
+    chain_plan pair({20, 30, 40}, sizeof(double));
+    CHECK(pair.peak(0, 1) == 0 && pair.kept(0, 1) == 20*40*sizeof(double));
+
+    temporary_pool& shared = temporary_pool::instance();
+
+    // over the limit, halves run one after the other on this thread, the
+    // one keeping least first
+    shared.set_limit(1);
+    std::vector<char> order;
+    const std::thread::id caller = std::this_thread::get_id();
+    bool on_caller = true;
+    budgeted_fork_join(10, 1, 5, 5,
+                       [&] { order.push_back('f'); on_caller &= std::this_thread::get_id() == caller; },
+                       [&] { order.push_back('g'); on_caller &= std::this_thread::get_id() == caller; });
+    CHECK(order == std::vector<char>({'f', 'g'}));
+    CHECK(on_caller);
+    order.clear();
+    budgeted_fork_join(5, 5, 10, 1, [&] { order.push_back('f'); }, [&] { order.push_back('g'); });
+    CHECK(order == std::vector<char>({'g', 'f'}));
+    shared.set_limit(0);
+
+    // a chain evaluated within a limit holds fewer temporaries, with the
+    // same result
+    matrix<double> A(500, 300), B(300, 1000), C(1000, 300), D(300, 100);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(C, 3);
+    fill_pattern(D, 4);
+    const std::size_t live = shared.get_live();
+    const double planned = (A*B*C*D).get_temporary_bytes();
+    shared.reset_peak();
+    matrix<double> fast = A*B*C*D;
+    const std::size_t fast_peak = shared.get_peak() - live;
+
+    shared.set_limit(std::size_t(planned) - 1);
+    CHECK((A*B*C*D).get_temporary_bytes() < planned);
+    shared.reset_peak();
+    matrix<double> small = A*B*C*D;
+    CHECK(shared.get_peak() - live < fast_peak);
+    shared.set_limit(0);
+
+    CHECK(same_entries(small, fast));
+    CHECK(same_entries(fast, reference_product<double>(reference_product<double>(reference_product<double>(A, B), C), D)));
+    return check_failures();
+}
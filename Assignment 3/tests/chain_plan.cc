@@ -0,0 +1,46 @@
+#include"check.h"
+
+// the order in which chains are evaluated: the cheapest of all splits
+int main() {
+    // the textbook chain, optimal as ((M0 (M1 M2)) ((M3 M4) M5))
+    const std::vector<unsigned> dims = {30, 35, 15, 5, 10, 20, 25};
+    chain_plan textbook(dims, sizeof(double));
+    CHECK(textbook.split(0, 5) == 2);
+    CHECK(textbook.split(0, 2) == 0 && textbook.split(3, 5) == 4);
+    CHECK(textbook.cost(1, 2) == chain_step_cost(35, 15, 5, sizeof(double)));
+    CHECK(textbook.cost(0, 0) == 0 && textbook.cost() == textbook.cost(0, 5));
+
+    // the planner known at compile time agrees
+    typedef static_chain_plan<sizeof(double), 30, 35, 15, 5, 10, 20, 25> fixed;
+    for (unsigned i=0; i!=6; ++i)
+        for (unsigned j=i+1; j!=6; ++j)
+            CHECK(fixed::split(i, j) == textbook.split(i, j) && fixed::cost(i, j) == textbook.cost(i, j));
+
+    // a chain where the wrong order makes a 1000 x 1000 temporary
+    chain_plan skewed({10, 1000, 10, 1000}, sizeof(double));
+    CHECK(skewed.split(0, 2) == 1);
+    CHECK(skewed.cost() == chain_step_cost(10, 1000, 10, sizeof(double))
+                           + chain_step_cost(10, 10, 1000, sizeof(double)));
+
+    // products follow the plan: only the 10 x 10 temporary is taken
+    matrix<double> A(10, 1000), B(1000, 10), C(10, 1000);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(C, 3);
+    CHECK((A*B*C).get_temporary_bytes() == 10*10*sizeof(double));
+    matrix<double> ABC = A*B*C;
+    CHECK(same_entries(ABC, reference_product<double>(reference_product<double>(A, B), C)));
+
+    // and a longer chain comes out right in its order
+    std::vector<matrix<double>> M;
+    for (unsigned i=0; i!=6; ++i) {
+        M.emplace_back(dims[i], dims[i+1]);
+        fill_pattern(M[i], i);
+    }
+    matrix<double> chain = M[0]*M[1]*M[2]*M[3]*M[4]*M[5];
+    std::vector<matrix<double>> partial = {M[0]};
+    for (unsigned i=1; i!=6; ++i) partial.push_back(reference_product<double>(partial.back(), M[i]));
+    CHECK(same_entries(chain, partial.back()));
+
+    return check_failures();
+}
@@ -0,0 +1,81 @@
+#ifndef MATRIXLIB_TESTS_CHECK_H
+#define MATRIXLIB_TESTS_CHECK_H
+
+#include<iostream>
+#include<cmath>
+#include<vector>
+#include<type_traits>
+
+#include"matrix.h"
+#include"operations.h"
+
+// checks print what failed and where; a test returns the number of failures
+inline int& check_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond) \
+    ((cond) ? (void)0 : (void)(++check_failures(), \
+            std::cout << __FILE__ << ':' << __LINE__ << ": check failed: " #cond "\n"))
+
+// fills M with small integers from a seed, so that products are exact
+template<class M>
+void fill_pattern(M& m, unsigned seed) {
+    for (unsigned i=0; i!=m.get_height(); ++i)
+        for (unsigned j=0; j!=m.get_width(); ++j)
+            m(i,j) = std::decay_t<decltype(m(i,j))>(int((i*7 + j*13 + seed*31) % 11) - 5);
+}
+
+// the product of two expressions by the textbook triple loop
+template<typename T, class L, class R>
+matrix<T> reference_product(const L& lhs, const R& rhs) {
+    matrix<T> result(lhs.get_height(), rhs.get_width());
+    for (unsigned i=0; i!=lhs.get_height(); ++i)
+        for (unsigned j=0; j!=rhs.get_width(); ++j) {
+            T sum = T(0);
+            for (unsigned k=0; k!=lhs.get_width(); ++k) sum += lhs(i,k)*rhs(k,j);
+            result(i,j) = sum;
+        }
+    return result;
+}
+
+template<class A, class B>
+bool same_entries(const A& a, const B& b, double tolerance = 0) {
+    if (a.get_height()!=b.get_height() || a.get_width()!=b.get_width()) return false;
+    for (unsigned i=0; i!=a.get_height(); ++i)
+        for (unsigned j=0; j!=a.get_width(); ++j)
+            if (std::fabs(double(a(i,j)) - double(b(i,j))) > tolerance) return false;
+    return true;
+}
+
+// allocator keeping count of the bytes it has handed out and not taken back
+template<typename U>
+struct counting_allocator {
+    typedef U value_type;
+
+    counting_allocator() {}
+    template<typename V>
+    counting_allocator(const counting_allocator<V>&) {}
+
+    static std::size_t& live() {
+        static std::size_t bytes = 0;
+        return bytes;
+    }
+
+    U* allocate(std::size_t n) {
+        live() += n*sizeof(U);
+        return std::allocator<U>().allocate(n);
+    }
+    void deallocate(U* p, std::size_t n) {
+        live() -= n*sizeof(U);
+        std::allocator<U>().deallocate(p, n);
+    }
+
+    template<typename V>
+    bool operator ==(const counting_allocator<V>&) const { return true; }
+    template<typename V>
+    bool operator !=(const counting_allocator<V>&) const { return false; }
+};
+
+#endif //MATRIXLIB_TESTS_CHECK_H
@@ -0,0 +1,55 @@
+#include"check.h"
+
+// repeated sub-expressions are evaluated once: the pool of temporaries hands
+// out as many blocks as there are distinct intermediates
+int main() {
+    // a split into two identical halves pays for one of them
+    chain_plan distinct({10, 10, 10, 10, 10}, sizeof(double));
+    chain_plan twins({10, 10, 10, 10, 10}, sizeof(double), {0, 1, 0, 1});
+    CHECK(twins.split(0, 3) == 1);
+    CHECK(twins.cost() == twins.cost(0, 1) + chain_step_cost(10, 10, 10, sizeof(double)));
+    CHECK(twins.cost() < distinct.cost());
+
+    matrix<double> A(100, 100), B(100, 100), C(100, 100);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(C, 3);
+    const matrix<double> AB = reference_product<double>(A, B);
+    const matrix<double> AC = reference_product<double>(A, C);
+    temporary_pool& pool = temporary_pool::instance();
+
+    // one intermediate: A*B, kept while C multiplies it
+    std::size_t total = pool.get_total();
+    matrix<double> ABC = A*B*C;
+    const std::size_t one = pool.get_total() - total;
+    CHECK(one != 0);
+    CHECK(same_entries(ABC, reference_product<double>(AB, C)));
+
+    // (A*B)*(A*B): A*B once
+    total = pool.get_total();
+    matrix<double> ABAB = A*B*A*B;
+    CHECK(pool.get_total() - total == one);
+    CHECK(same_entries(ABAB, reference_product<double>(AB, AB)));
+
+    // twice the same product in a sum, against two different ones
+    total = pool.get_total();
+    matrix<double> twice = A*B + A*B;
+    CHECK(pool.get_total() - total == one);
+    total = pool.get_total();
+    matrix<double> both = A*B + A*C;
+    CHECK(pool.get_total() - total == 2*one);
+    CHECK(same_entries(twice, AB + AB) && same_entries(both, AB + AC));
+
+    // and the same sum on both sides of a product
+    total = pool.get_total();
+    matrix<double> square = (A+B)*(A+B);
+    CHECK(pool.get_total() - total == one);
+    matrix<double> sum = A+B;
+    CHECK(same_entries(square, reference_product<double>(sum, sum)));
+
+    // a transpose or a window of an operand is another operand
+    matrix<double> Bt = A*B.transpose()*A*B;
+    CHECK(same_entries(Bt, reference_product<double>(reference_product<double>(A, B.transpose()), AB)));
+
+    return check_failures();
+}
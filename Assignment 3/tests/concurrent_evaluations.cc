@@ -0,0 +1,40 @@
+#include<atomic>
+#include<thread>
+
+#include"check.h"
+
+// unrelated expressions evaluated from several threads at once, each
+// sharing nothing with the others but the pool of workers
+int main() {
+    const unsigned threads = 6;
+    std::vector<matrix<double>> A, B, C, expected_chain, expected_sum;
+    for (unsigned t=0; t!=threads; ++t) {
+        A.emplace_back(60+t, 50);
+        B.emplace_back(50, 70);
+        C.emplace_back(70, 60+t);
+        fill_pattern(A[t], t);
+        fill_pattern(B[t], t+1);
+        fill_pattern(C[t], t+2);
+        expected_chain.push_back(reference_product<double>(reference_product<double>(A[t], B[t]), C[t]));
+        matrix<double> sum(60+t, 60+t);
+        for (unsigned i=0; i!=60+t; ++i)
+            for (unsigned j=0; j!=60+t; ++j) sum(i,j) = expected_chain[t](i,j) + 2*expected_chain[t](j,i);
+        expected_sum.push_back(sum);
+    }
+
+    std::atomic<unsigned> wrong{0};
+    std::vector<std::thread> requests;
+    for (unsigned t=0; t!=threads; ++t)
+        requests.emplace_back([&, t] {
+            for (unsigned n=0; n!=10; ++n) {
+                const matrix<double> chain = A[t]*B[t]*C[t];
+                if (!same_entries(chain, expected_chain[t])) ++wrong;
+                const matrix<double> sum = chain + chain.transpose() + chain.transpose();
+                if (!same_entries(sum, expected_sum[t])) ++wrong;
+            }
+        });
+    for (auto& r : requests) r.join();
+    CHECK(wrong == 0);
+
+    return check_failures();
+}
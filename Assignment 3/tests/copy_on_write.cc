@@ -0,0 +1,165 @@
+#include<thread>
+
+#include"check.h"
+
+// copies share storage until one of them is written, and never when a
+// reference into it may still be held
+int main() {
+    matrix<double> X(30, 20);
+    fill_pattern(X, 1);
+    const matrix<double> original = X;
+    const double x00 = X(0,0);
+
+    // X was written through references: its copies are deep
+    CHECK(get_buffer(original)!=get_buffer(X));
+
+    // once X declares its references done, copies share its storage again
+    {
+        matrix<int> B(6, 5);
+        for (unsigned i=0; i!=6; ++i)
+            for (unsigned j=0; j!=5; ++j) B(i,j) = int(i*5 + j);
+        B.share();
+        const matrix<int> BC = B;
+        CHECK(get_buffer(B)==get_buffer(BC));
+        B(2,2) = -1;
+        CHECK(BC(2,2)==12 && get_buffer(B)!=get_buffer(BC));
+        matrix<int,2,2> S;
+        fill_pattern(S, 9);
+        S.share();
+        const matrix<int,2,2> SC = S;
+        CHECK(get_buffer(S)==get_buffer(SC));
+    }
+
+    // copies are independent in both directions
+    {
+        const matrix<double> cx = original;
+        matrix<double> Y = cx;
+        CHECK(get_buffer(Y)==get_buffer(cx));
+        Y(0,0) = 100;
+        CHECK(cx(0,0)==x00 && Y(0,0)==100);
+        matrix<double> Z = Y;
+        Z(2,3) = -7;
+        CHECK(Y(2,3)!=-7 && Z(0,0)==100);
+    }
+
+    // an iterator taken before the copy writes to the original only
+    {
+        matrix<double> A(4, 4);
+        fill_pattern(A, 2);
+        auto it = A.begin();
+        matrix<double> B = A;
+        *it = 5;
+        CHECK(A(0,0)==5);
+        CHECK(static_cast<const matrix<double>&>(B)(0,0)!=5);
+    }
+
+    // and so does a reference
+    {
+        matrix<double> A(4, 4);
+        fill_pattern(A, 3);
+        double& r = A(1,1);
+        matrix<double> B = A;
+        r = 9;
+        CHECK(static_cast<const matrix<double>&>(B)(1,1)!=9);
+    }
+
+    // a clone comes from the allocator of the storage it copies
+    {
+        std::size_t& live = counting_allocator<char>::live();
+        const std::size_t before = live;
+        matrix<double> A(10, 10, counting_allocator<char>());
+        fill_pattern(A, 10);
+        A.share();
+        const std::size_t one = live - before;
+        matrix<double> B = A;
+        CHECK(live - before == one);
+        B(0,0) = 1;
+        CHECK(live - before == 2*one);
+    }
+
+    // views follow the matrix they were taken from through its writes
+    {
+        matrix<double> V = original;
+        const matrix<double>& cx = V;
+        matrix<double> Y = cx;
+        auto t = cx.transpose();
+        auto w = cx.window({1, 5, 2, 6});
+        CHECK(get_buffer(Y)==get_buffer(cx));
+        V(3,2) = 42;
+        CHECK(t(2,3)==42 && w(2,0)==42);
+        CHECK(static_cast<const matrix<double>&>(Y)(3,2)==original(3,2));
+        w(0,0) = 43;
+        CHECK(cx(1,2)==43 && static_cast<const matrix<double>&>(Y)(1,2)==original(1,2));
+    }
+
+    // results written through their raw view leave earlier copies alone
+    {
+        matrix<double> A(8, 8), B(8, 8);
+        fill_pattern(A, 4);
+        fill_pattern(B, 5);
+        matrix<double> P = A*B;
+        const matrix<double> Q = P;
+        force_multiplication(B*A, P);
+        CHECK(same_entries(Q, reference_product<double>(A, B)));
+        CHECK(same_entries(P, reference_product<double>(B, A)));
+    }
+
+    // sized matrices behave the same
+    {
+        matrix<int,3,3> S;
+        fill_pattern(S, 6);
+        auto it = S.begin();
+        matrix<int,3,3> T = S;
+        *it = 77;
+        const matrix<int,3,3>& ct = T;
+        CHECK(ct(0,0)!=77);
+        const matrix<int,3,3> U = T;
+        T(2,2) = 55;
+        CHECK(U(2,2)!=55);
+    }
+
+    // views of a shared matrix taken from several threads at once
+    {
+        const matrix<double> shared = original;
+        const matrix<double> other = shared;
+        std::vector<std::thread> readers;
+        double sums[4] = {};
+        for (unsigned t=0; t!=4; ++t)
+            readers.emplace_back([&, t] {
+                for (unsigned n=0; n!=200; ++n) {
+                    const auto v = shared.transpose();
+                    sums[t] += v(1,2);
+                }
+            });
+        for (auto& r : readers) r.join();
+        for (double s : sums) CHECK(s==200*original(2,1));
+        CHECK(get_buffer(shared)==get_buffer(other));
+    }
+
+    // reading an entry through a const wrap does not write to the matrix
+    {
+        const matrix<double> w1 = original;
+        const matrix<double> w2 = w1;
+        const matrix_wrap<double> wrap = w1;
+        CHECK(wrap(1,1)==original(1,1));
+        CHECK(get_buffer(w1)==get_buffer(w2));
+    }
+
+    // a parallel product reads a shared operand that is not addressable,
+    // block by block from many tasks, without writing to it
+    {
+        matrix<double> column(600, 1), M(600, 600);
+        fill_pattern(column, 7);
+        fill_pattern(M, 8);
+        const matrix<double> d1 = column;
+        const matrix<double> d2 = d1;
+        CHECK(get_buffer(d1)==get_buffer(d2));
+        matrix<double> P = d1.diagonal_matrix()*M;
+        CHECK(same_entries(P, reference_product<double>(d1.diagonal_matrix(), M)));
+        CHECK(get_buffer(d1)==get_buffer(d2));
+        const matrix<double> d3 = d1;
+        CHECK(get_buffer(d3)==get_buffer(d1));
+    }
+
+    return check_failures();
+}
@@ -0,0 +1,40 @@
+#include"check.h"
+
+// diagonal() and trace() of unevaluated products against the diagonal of
+// the evaluated product
+template<class P>
+void check_diagonal(P&& product, const matrix<double>& full) {
+    const matrix<double> diag = product.diagonal();
+    const unsigned m = std::min(full.get_height(), full.get_width());
+    CHECK(diag.get_height()==m && diag.get_width()==1);
+    double trace = 0;
+    for (unsigned i=0; i!=m; ++i) {
+        CHECK(diag(i,0)==full(i,i));
+        trace += full(i,i);
+    }
+    CHECK(product.trace()==trace);
+}
+
+int main() {
+    matrix<double> A(30, 30), B(30, 30), G(25, 40), u(40, 1), v(1, 40), W(40, 35);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(G, 3);
+    fill_pattern(u, 4);
+    fill_pattern(v, 5);
+    fill_pattern(W, 6);
+
+    check_diagonal(A*B, reference_product<double>(A, B));
+    check_diagonal(G*G.transpose(), reference_product<double>(G, G.transpose()));
+    check_diagonal(A*B*A, reference_product<double>(reference_product<double>(A, B), A));
+    check_diagonal(A*B*A*B, reference_product<double>(reference_product<double>(A, B),
+                                                      reference_product<double>(A, B)));
+    // thin factors in the middle and at the ends, non-square results
+    check_diagonal(G*u*v*W, reference_product<double>(reference_product<double>(G, u),
+                                                      reference_product<double>(v, W)));
+    check_diagonal(v.transpose()*v*W, reference_product<double>(reference_product<double>(v.transpose(), v), W));
+    check_diagonal(G*W*W.transpose()*G.transpose(),
+                   reference_product<double>(reference_product<double>(G, W),
+                                             reference_product<double>(W.transpose(), G.transpose())));
+    return check_failures();
+}
@@ -0,0 +1,49 @@
+#include"check.h"
+
+// entries, rows and columns of unevaluated products and sums
+int main() {
+    matrix<double> A(40, 30), B(30, 50), C(50, 20), D(40, 50);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(C, 3);
+    fill_pattern(D, 4);
+    const matrix<double> AB = reference_product<double>(A, B);
+    const matrix<double> ABC = reference_product<double>(AB, C);
+
+    const auto product = A*B*C;
+    CHECK(product(0, 0) == ABC(0, 0));
+    CHECK(product(17, 11) == ABC(17, 11));
+    CHECK(product(39, 19) == ABC(39, 19));
+    CHECK(same_entries(product.row(23), ABC.window({23, 24, 0, 20})));
+    CHECK(same_entries(product.col(5), ABC.window({0, 40, 5, 6})));
+
+    // operands read through views
+    const auto transposed = A*C.transpose().window({0, 20, 0, 30}).transpose();
+    const matrix<double> expected = reference_product<double>(A, C.transpose().window({0, 20, 0, 30}).transpose());
+    CHECK(transposed(7, 3) == expected(7, 3));
+    CHECK(same_entries(transposed.row(39), expected.window({39, 40, 0, 20})));
+
+    // every term of a sum, products included
+    matrix<double> P(30, 20), Q(20, 30), S(30, 30);
+    fill_pattern(P, 5);
+    fill_pattern(Q, 6);
+    fill_pattern(S, 7);
+    const matrix<double> PQ = reference_product<double>(P, Q);
+    const auto sum = P*Q + S + S;
+    for (unsigned i=0; i<30; i+=7)
+        for (unsigned j=0; j<30; j+=4)
+            CHECK(sum(i, j) == PQ(i, j) + 2*S(i, j));
+    const auto plain = D + D;
+    matrix<double> row = plain.row(2), col = plain.col(49);
+    for (unsigned j=0; j!=50; ++j) CHECK(row(0, j) == 2*D(2, j));
+    for (unsigned i=0; i!=40; ++i) CHECK(col(i, 0) == 2*D(i, 49));
+    matrix<double> sum_row = sum.row(29);
+    for (unsigned j=0; j!=30; ++j) CHECK(sum_row(0, j) == PQ(29, j) + 2*S(29, j));
+
+    // the expression still sees writes to its operands
+    A(17, 4) += 1;
+    const matrix<double> BC = reference_product<double>(B, C);
+    CHECK(product(17, 11) == ABC(17, 11) + BC(4, 11));
+
+    return check_failures();
+}
@@ -0,0 +1,59 @@
+#include"check.h"
+
+// the packed product, on shapes that leave partial tiles, blocks and panels
+int main() {
+    // a tile of the micro-kernel written in part, then accumulated into
+    {
+        const int a[4*2] = {1, 2, 3, 4, 5, 6, 7, 8};
+        const int b[2*4] = {1, 0, 2, 1, 0, 1, 1, 3};
+        int c[3*5] = {};
+        generic_micro_kernel<int,4,4>(2, a, b, c, 5, 3, 2, false);
+        CHECK(c[0]==1 && c[1]==5 && c[5]==2 && c[6]==6 && c[10]==3 && c[11]==7);
+        CHECK(c[2]==0 && c[7]==0 && c[12]==0);
+        generic_micro_kernel<int,4,4>(2, a, b, c, 5, 3, 2, true);
+        CHECK(c[0]==2 && c[11]==14);
+    }
+
+    // sides that are no multiple of the tile, of the row block or of the depth
+    // of a packed panel: every edge case of the blocking at once
+    matrix<int> A(gemm_mc+37, gemm_kc+45), B(gemm_kc+45, 131);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    matrix<int> AB = A*B;
+    CHECK(same_entries(AB, reference_product<int>(A, B)));
+
+    // results wider than a column panel
+    matrix<int> C(9, 7), D(7, gemm_nc+5);
+    fill_pattern(C, 3);
+    fill_pattern(D, 4);
+    matrix<int> CD = C*D;
+    CHECK(same_entries(CD, reference_product<int>(C, D)));
+
+    // floating point, single rows and columns, and an empty inner dimension
+    matrix<double> E(1, 50), F(50, 1), G(3, 0), H(0, 4);
+    fill_pattern(E, 5);
+    fill_pattern(F, 6);
+    matrix<double> EF = E*F, FE = F*E;
+    CHECK(same_entries(EF, reference_product<double>(E, F)));
+    CHECK(same_entries(FE, reference_product<double>(F, E)));
+    matrix<double> GH = G*H;
+    CHECK(GH.get_height()==3 && GH.get_width()==4);
+    CHECK(same_entries(GH, matrix<double>(3, 4)));
+    matrix<float> X(33, 17), Y(17, 29);
+    fill_pattern(X, 7);
+    fill_pattern(Y, 8);
+    matrix<float> XY = X*Y;
+    CHECK(same_entries(XY, reference_product<float>(X, Y)));
+
+    // into a window of a larger matrix, whose rows are further apart than
+    // its width: the entries around it are left alone
+    matrix<int> big(gemm_mc+50, 200);
+    matrix<int> P(gemm_mc+20, 40), Q(40, 150);
+    fill_pattern(P, 9);
+    fill_pattern(Q, 10);
+    force_multiplication(P*Q, big.window({10, gemm_mc+30, 20, 170}));
+    CHECK(same_entries(big.window({10, gemm_mc+30, 20, 170}), reference_product<int>(P, Q)));
+    CHECK(big(9, 20)==0 && big(10, 19)==0 && big(10, 170)==0 && big(gemm_mc+30, 20)==0);
+
+    return check_failures();
+}
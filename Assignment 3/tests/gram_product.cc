@@ -0,0 +1,34 @@
+#include"check.h"
+
+// X * X.transpose() computes one triangle and mirrors it; products that only
+// look like it must not
+int main() {
+    matrix<double> A(40, 30);
+    fill_pattern(A, 1);
+
+    matrix<double> G = A*A.transpose();
+    CHECK(same_entries(G, reference_product<double>(A, A.transpose())));
+    for (unsigned i=0; i!=G.get_height(); ++i)
+        for (unsigned j=0; j!=i; ++j) CHECK(G(i,j)==G(j,i));
+
+    // same buffer and steps, but a narrower right side: not square
+    matrix<double> N = A*A.window({0, 20, 0, 30}).transpose();
+    CHECK(N.get_height()==40 && N.get_width()==20);
+    CHECK(same_entries(N, reference_product<double>(A, A.window({0, 20, 0, 30}).transpose())));
+
+    // square, but the two sides are different windows of the same buffer
+    matrix<double> W = A.window({0, 20, 0, 30})*A.window({10, 30, 0, 30}).transpose();
+    CHECK(same_entries(W, reference_product<double>(A.window({0, 20, 0, 30}),
+                                                     A.window({10, 30, 0, 30}).transpose())));
+
+    matrix<double> V = A.window({5, 25, 0, 30})*A.window({5, 25, 0, 30}).transpose();
+    CHECK(same_entries(V, reference_product<double>(A.window({5, 25, 0, 30}),
+                                                    A.window({5, 25, 0, 30}).transpose())));
+
+    matrix<int,12,9> S;
+    fill_pattern(S, 2);
+    matrix<int,12,12> SS = S*S.transpose();
+    CHECK(same_entries(SS, reference_product<int>(S, S.transpose())));
+
+    return check_failures();
+}
@@ -0,0 +1,57 @@
+#include<cstdint>
+
+#include"check.h"
+
+bool on_huge_page_boundary(const void* p) {
+    return reinterpret_cast<std::uintptr_t>(p) % huge_page_size == 0;
+}
+
+// large blocks on 2MB boundaries, and the matrices stored in them
+int main() {
+    const std::size_t threshold = huge_page_threshold();
+    if (threshold != 0) {
+        CHECK(use_huge_pages(threshold) == bool(MATRIXLIB_HUGE_PAGES));
+        CHECK(!use_huge_pages(threshold-1));
+    }
+
+    // a block rounded up to whole pages, zeroed and writable to its end
+    const std::size_t bytes = huge_page_size + 12345;
+    char* block = static_cast<char*>(allocate_huge(bytes));
+    if (MATRIXLIB_HUGE_PAGES) {
+        CHECK(on_huge_page_boundary(block));
+        CHECK(block[0] == 0 && block[bytes-1] == 0);
+    }
+    block[0] = 1;
+    block[bytes-1] = 2;
+    CHECK(block[0] + block[bytes-1] == 3);
+    deallocate_huge(block, bytes);
+
+    huge_page_allocator<double> doubles;
+    double* many = doubles.allocate(1000);
+    many[999] = 1.5;
+    CHECK(many[999] == 1.5);
+    doubles.deallocate(many, 1000);
+    CHECK(huge_page_allocator<char>(doubles) == doubles);
+
+    // a matrix past the threshold: its buffer starts a page, its entries
+    // start zeroed, and products read and write it as any other
+    if (threshold == 0 || threshold > (std::size_t(64) << 20)) return check_failures();
+    const unsigned rows = unsigned(threshold / (400*sizeof(double))) + 10;
+    matrix<double> big(rows, 400), narrow(400, 8);
+    if (MATRIXLIB_HUGE_PAGES) CHECK(on_huge_page_boundary(get_buffer(big).get()));
+    const matrix<double>& read = big;
+    CHECK(read(0, 0) == 0 && read(rows-1, 399) == 0);
+    fill_pattern(big, 1);
+    fill_pattern(narrow, 2);
+    matrix<double> product = big*narrow;
+    CHECK(same_entries(product, reference_product<double>(big, narrow)));
+
+    // so does a copy of it, once written
+    big.share();
+    matrix<double> copy = big;
+    copy(0, 0) = 42;
+    if (MATRIXLIB_HUGE_PAGES) CHECK(on_huge_page_boundary(get_buffer(copy).get()));
+    CHECK(read(0, 0) != 42 && copy(1, 1) == read(1, 1));
+
+    return check_failures();
+}
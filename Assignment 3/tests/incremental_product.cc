@@ -0,0 +1,61 @@
+#include"check.h"
+#include"incremental_product.h"
+
+// products kept up to date as a few operand entries change
+int main() {
+    matrix<double> A(50, 40), B(40, 60);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    incremental_product<double> product(A, B);
+    CHECK(same_entries(product.get(), reference_product<double>(A, B)));
+
+    // a snapshot keeps the product it was taken from
+    const matrix<double> before = product.get();
+
+    // changed rows of the left operand
+    A(3, 7) = 9;
+    A(41, 0) -= 2;
+    CHECK(same_entries(product.get(), reference_product<double>(A, B)));
+    CHECK(!same_entries(before, reference_product<double>(A, B)));
+
+    // changed rows of the right operand, a rank-k correction
+    B(0, 59) = 4;
+    B(17, 3) += 1;
+    B(17, 30) -= 3;
+    CHECK(same_entries(product.get(), reference_product<double>(A, B)));
+
+    // both at once, then more rows than the correction is worth
+    A(10, 10) = -7;
+    B(39, 0) = 8;
+    CHECK(same_entries(product.get(), reference_product<double>(A, B)));
+    for (unsigned i=0; i!=40; ++i) B(i, i) += 1;
+    CHECK(same_entries(product.get(), reference_product<double>(A, B)));
+
+    // a write restoring the old value changes nothing
+    const double old = A(5, 5);
+    A(5, 5) = old;
+    CHECK(same_entries(product.get(), reference_product<double>(A, B)));
+
+    // operands seen through views, written through their matrices
+    matrix<double> C(30, 45), D(45, 30);
+    fill_pattern(C, 3);
+    fill_pattern(D, 4);
+    incremental_product<double> viewed(C.transpose(), D.transpose());
+    CHECK(same_entries(viewed.get(), reference_product<double>(C.transpose(), D.transpose())));
+    C(12, 4) = 6;
+    D(0, 29) = -6;
+    CHECK(same_entries(viewed.get(), reference_product<double>(C.transpose(), D.transpose())));
+
+    // updates read the operands without writing to them: a copy of one
+    // keeps sharing its storage, and its version does not move
+    const matrix<double> E = A;
+    const matrix<double> shared = E;
+    incremental_product<double> reading(E, B);
+    const unsigned long version = get_buffer(E)->get_version();
+    B(2, 2) += 1;
+    CHECK(same_entries(reading.get(), reference_product<double>(E, B)));
+    CHECK(get_buffer(E)==get_buffer(shared));
+    CHECK(get_buffer(E)->get_version()==version);
+
+    return check_failures();
+}
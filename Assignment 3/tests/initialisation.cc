@@ -0,0 +1,51 @@
+#include<string>
+
+#include"check.h"
+
+template<class M>
+bool all_zero(const M& m) {
+    for (unsigned i=0; i!=m.get_height(); ++i)
+        for (unsigned j=0; j!=m.get_width(); ++j)
+            if (m(i,j) != 0) return false;
+    return true;
+}
+
+// how the elements of new matrices start, and results written over storage
+// that was left as it was
+int main() {
+    // value-initialised by default, zeroed on request, padded rows included
+    const matrix<double> value(40, 64);
+    CHECK(all_zero(value));
+    const matrix<double> zeroed(300, 300, matrix_init::zeroed);
+    CHECK(all_zero(zeroed));
+    const matrix<int> padded(17, 128, matrix_init::zeroed);
+    CHECK(padded.get_stride() > padded.get_width() && all_zero(padded));
+    const matrix<double,5,7> sized(matrix_init::zeroed);
+    CHECK(all_zero(sized));
+
+    // elements whose default constructor does something are always built
+    const matrix<std::string> names(3, 4, matrix_init::uninitialized);
+    bool empty = true;
+    for (unsigned i=0; i!=3; ++i)
+        for (unsigned j=0; j!=4; ++j) empty &= names(i,j).empty();
+    CHECK(empty);
+
+    // a temporary reusing a block left full of other values: every entry of
+    // the product is written
+    matrix<double> A(100, 100), B(100, 100), C(100, 100);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(C, 3);
+    {
+        matrix<double> garbage(100, 100, pool_allocator<char>(), matrix_init::uninitialized);
+        for (auto& x : garbage) x = 1e300;
+    }
+    matrix<double> ABC = A*B*C;
+    CHECK(same_entries(ABC, reference_product<double>(reference_product<double>(A, B), C)));
+
+    // and so is every entry of a sum into a fresh result
+    matrix<double> sum = A+B+C;
+    CHECK(sum(99, 99) == A(99, 99)+B(99, 99)+C(99, 99) && sum(0, 0) == A(0, 0)+B(0, 0)+C(0, 0));
+
+    return check_failures();
+}
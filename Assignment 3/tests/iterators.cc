@@ -0,0 +1,51 @@
+#include<algorithm>
+#include<iterator>
+#include<type_traits>
+
+#include"check.h"
+
+static_assert(std::is_same<std::iterator_traits<matrix<int>::iterator>::iterator_category,
+                           std::random_access_iterator_tag>::value, "matrix iterators are random access");
+
+// iterators over rows padded past their width (128 ints are 512 bytes)
+int main() {
+    matrix<int> A(5, 128);
+    CHECK(A.get_stride() != A.get_width());
+    int k = 0;
+    for (auto& x : A) x = (k++ * 37) % 101;
+
+    CHECK(A.end() - A.begin() == 5*128);
+    CHECK(std::distance(A.begin(), A.end()) == 5*128);
+    CHECK(&*(A.begin() + 130) == &A(1, 2));
+    CHECK(&*(A.end() - 1) == &A(4, 127));
+    CHECK(&A.begin()[300] == &A(2, 44));
+    CHECK(A.begin() + 130 - 3 == A.begin() + 127);
+    CHECK((A.begin() + 127) - (A.begin() + 130) == -3);
+    CHECK(A.begin() + 128 < A.begin() + 129 && A.end() > A.begin());
+
+    auto it = A.end();
+    for (unsigned i=0; i!=128; ++i) --it;
+    CHECK(&*it == &A(4, 0));
+    --it;
+    CHECK(&*it == &A(3, 127));
+
+    // algorithms needing random access skip the padding
+    std::sort(A.begin(), A.end());
+    CHECK(std::is_sorted(A.begin(), A.end()));
+    CHECK(std::binary_search(A.begin(), A.end(), 50));
+    std::reverse(A.begin(), A.end());
+    CHECK(std::is_sorted(std::make_reverse_iterator(A.end()), std::make_reverse_iterator(A.begin())));
+
+    const matrix<int>& C = A;
+    CHECK(std::lower_bound(C.begin(), C.end(), 50, std::greater<int>()) - C.begin()
+          == std::count_if(C.begin(), C.end(), [](int x) { return x > 50; }));
+
+    // a matrix without columns has no elements
+    matrix<int> empty(4, 0);
+    CHECK(empty.begin() == empty.end());
+    CHECK(empty.end() - empty.begin() == 0);
+    CHECK(empty.begin() + 0 == empty.end());
+    std::sort(empty.begin(), empty.end());
+
+    return check_failures();
+}
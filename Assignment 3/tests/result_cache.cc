@@ -0,0 +1,94 @@
+#include"check.h"
+
+// products of unchanged operands come from the cache, as copies that writes
+// to one holder keep from every other
+int main() {
+    result_cache<double>& cache = result_cache<double>::instance();
+    cache.set_budget(std::size_t(64) << 20);
+
+    matrix<double> A(40, 30), B(30, 20), C(20, 10);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(C, 3);
+    A.share();
+    B.share();
+    C.share();
+    const matrix<double> expected = reference_product<double>(reference_product<double>(A, B), C);
+
+    matrix_ref<double,Plain> first = (A*B*C).materialise();
+    const std::size_t hits = cache.get_hits();
+    matrix_ref<double,Plain> second = (A*B*C).materialise();
+    CHECK(cache.get_hits() > hits);
+    CHECK(same_entries(first, expected) && same_entries(second, expected));
+
+    // a write to one result reaches neither the other nor the cache
+    first(0,0) = 1e6;
+    second(1,1) = -1e6;
+    matrix_ref<double,Plain> third = (A*B*C).materialise();
+    CHECK(same_entries(third, expected));
+    CHECK(second(0,0)==expected(0,0) && first(1,1)==expected(1,1));
+
+    // nor does a write through a view of it
+    auto window = third.window({0, 2, 0, 2});
+    window(0,0) = 5;
+    CHECK(third(0,0)==5);
+    CHECK(same_entries((A*B*C).materialise(), expected));
+
+    // writing an operand makes its entries unreachable
+    A(0,0) += 1;
+    A.share();
+    const matrix<double> changed = reference_product<double>(reference_product<double>(A, B), C);
+    CHECK(same_entries((A*B*C).materialise(), changed));
+
+    // a write through a reference taken before the product moves no
+    // version: products of such an operand are not cached
+    double& r = A(1,1);
+    const matrix<double> before = A*B*C;
+    r = 100;
+    const matrix<double> after = A*B*C;
+    CHECK(same_entries(after, reference_product<double>(reference_product<double>(A, B), C)));
+    CHECK(!same_entries(after, before));
+    auto it = B.begin();
+    const matrix<double> unchanged = A*B*C;
+    *it = 77;
+    const matrix<double> written = A*B*C;
+    CHECK(same_entries(written, reference_product<double>(reference_product<double>(A, B), C)));
+    CHECK(!same_entries(written, unchanged));
+
+    // until the operands are shared again
+    A.share();
+    B.share();
+    const matrix<double> recomputed = reference_product<double>(reference_product<double>(A, B), C);
+    const matrix<double> warm = A*B*C;
+    const std::size_t warm_hits = cache.get_hits();
+    const matrix<double> hot = A*B*C;
+    CHECK(same_entries(hot, recomputed) && same_entries(warm, recomputed));
+    CHECK(cache.get_hits() > warm_hits);
+
+    // conversions go through the cache as well
+    matrix<double> P = A*B*C;
+    P(2,2) = 0;
+    matrix<double> Q = A*B*C;
+    CHECK(same_entries(Q, recomputed));
+
+    // an operand that is gone releases its storage, and its entries are
+    // dropped at the next insertion
+    {
+        std::size_t& live = counting_allocator<char>::live();
+        {
+            matrix<double> D(60, 30, counting_allocator<char>());
+            fill_pattern(D, 4);
+            D.share();
+            matrix_ref<double,Plain> R = (D*B).materialise();
+            CHECK(live != 0 && same_entries(R, reference_product<double>(D, B)));
+        }
+        CHECK(live == 0);
+        const std::size_t bytes = cache.get_bytes();
+        (B*C).materialise();
+        CHECK(cache.get_bytes() < bytes + 30*10*sizeof(double));
+    }
+
+    cache.clear();
+    cache.set_budget(0);
+    return check_failures();
+}
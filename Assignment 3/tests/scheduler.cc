@@ -0,0 +1,81 @@
+#include<atomic>
+#include<chrono>
+#include<set>
+#include<thread>
+#include<mutex>
+#if defined(__linux__)
+#include<dirent.h>
+#endif
+
+#include"check.h"
+
+// threads of the process, where the system tells
+unsigned process_threads() {
+    unsigned n = 0;
+#if defined(__linux__)
+    if (DIR* dir = opendir("/proc/self/task")) {
+        while (dirent* entry = readdir(dir))
+            if (entry->d_name[0] != '.') ++n;
+        closedir(dir);
+    }
+#endif
+    return n;
+}
+
+// the work-stealing pool: idle workers take the tasks a busy one queued,
+// full queues run tasks in place, and nested evaluations start no thread
+int main() {
+    // the tasks a worker queues in its own deque are stolen by the others
+    {
+        thread_pool pool(4, 64);
+        std::mutex mtx;
+        std::set<std::thread::id> ran_on;
+        task_group outer(pool);
+        outer.run([&] {
+            task_group inner(pool);
+            for (int i=0; i!=8; ++i)
+                inner.run([&] {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    std::lock_guard<std::mutex> lock(mtx);
+                    ran_on.insert(std::this_thread::get_id());
+                });
+            inner.wait();
+        });
+        outer.wait();
+        CHECK(ran_on.size() > 1);
+    }
+
+    // a task that does not fit in the queue is run by the thread submitting it
+    {
+        thread_pool pool(1, 1);
+        std::atomic<bool> started{false}, release{false};
+        task_group tasks(pool);
+        tasks.run([&] {
+            started = true;
+            while (!release) std::this_thread::yield();
+        });
+        while (!started) std::this_thread::yield();
+        tasks.run([] {});
+        std::thread::id ran_on;
+        tasks.run([&] { ran_on = std::this_thread::get_id(); });
+        CHECK(ran_on == std::this_thread::get_id());
+        release = true;
+        tasks.wait();
+    }
+
+    // nested sums and products share the workers of the pool
+    matrix<double> A(200, 200), B(200, 200), C(200, 200), D(200, 200);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(C, 3);
+    fill_pattern(D, 4);
+    matrix<double> warm = A*B;
+    const unsigned threads = process_threads();
+    matrix<double> AB = A+B, CD = C+D;
+    matrix<double> nested = (A+B)*(C+D) + A*B*C;
+    CHECK(same_entries(nested, reference_product<double>(AB, CD)
+                               + reference_product<double>(reference_product<double>(A, B), C)));
+    CHECK(process_threads() == threads);
+
+    return check_failures();
+}
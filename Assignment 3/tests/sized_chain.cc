@@ -0,0 +1,58 @@
+#include"check.h"
+
+// chains of sized operands, planned at compile time
+typedef static_chain_plan<sizeof(double), 10, 30, 5, 60> plan;
+static_assert(plan::split(0, 2) == 1, "(A*B)*C is the cheaper order");
+static_assert(plan::cost(0, 0) == 0 && plan::peak(1, 1) == 0, "single factors cost nothing");
+static_assert(plan::cost(0, 2) == plan::cost(0, 1) + chain_step_cost(10, 5, 60, sizeof(double)),
+              "the cost of a chain is that of its steps");
+
+int main() {
+    matrix<int,10,30> A;
+    matrix<int,30,5> B;
+    matrix<int,5,60> C;
+    matrix<int,12,5> D;
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(C, 3);
+    fill_pattern(D, 4);
+
+    // small steps, left to the constant loops
+    matrix<int,10,60> ABC = A*B*C;
+    CHECK(same_entries(ABC, reference_product<int>(reference_product<int>(A, B), C)));
+
+    // transposed and non-addressable factors
+    matrix<int,10,12> ABDt = A*B*D.transpose();
+    CHECK(same_entries(ABDt, reference_product<int>(reference_product<int>(A, B), D.transpose())));
+    matrix<int,5,1> v;
+    fill_pattern(v, 5);
+    matrix<int,30,60> BvC = B*v.diagonal_matrix()*C;
+    CHECK(same_entries(BvC, reference_product<int>(reference_product<int>(B, v.diagonal_matrix()), C)));
+    // reading a factor does not write to it: copies keep sharing storage
+    const matrix<int,5,1> shared = v;
+    const matrix<int,5,1> other = shared;
+    matrix<int,30,60> BsC = B*shared.diagonal_matrix()*C;
+    CHECK(same_entries(BsC, BvC));
+    CHECK(get_buffer(shared)==get_buffer(other));
+
+    // steps through the packed kernel, halves computed concurrently
+    matrix<double,160,150> E;
+    matrix<double,150,170> F;
+    matrix<double,170,140> G;
+    matrix<double,140,160> H;
+    fill_pattern(E, 6);
+    fill_pattern(F, 7);
+    fill_pattern(G, 8);
+    fill_pattern(H, 9);
+    matrix<double,160,160> EFGH = E*F*G*H;
+    CHECK(same_entries(EFGH, reference_product<double>(reference_product<double>(E, F),
+                                                       reference_product<double>(G, H))));
+
+    // the same chain into a dynamic matrix, and with Strassen
+    matrix<double> dynamic = E*F*G*H;
+    CHECK(same_entries(dynamic, EFGH));
+    matrix<double,160,160> fast = (E*F*G*H).strassen(64);
+    CHECK(same_entries(fast, EFGH, 1e-6));
+
+    return check_failures();
+}
@@ -0,0 +1,52 @@
+#include"check.h"
+
+// Strassen products, with the recursion cut low so that it runs several levels
+int main() {
+    matrix<int> A(75, 66), B(66, 81), C(81, 66);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(C, 3);
+
+    // odd sides at every level, operands read in place
+    matrix<int> AB = (A*B).strassen(8);
+    CHECK(same_entries(AB, reference_product<int>(A, B)));
+
+    // windows are read in place as well
+    matrix<int> W = (A.window({3, 60, 1, 50})*B.window({10, 59, 5, 70})).strassen(8);
+    CHECK(same_entries(W, reference_product<int>(A.window({3, 60, 1, 50}), B.window({10, 59, 5, 70}))));
+
+    // transposed and non-addressable operands are copied
+    matrix<int> ACt = (A*C.transpose()).strassen(8);
+    CHECK(same_entries(ACt, reference_product<int>(A, C.transpose())));
+    matrix<int> v(66, 1);
+    fill_pattern(v, 4);
+    matrix<int> Av = (A*v.diagonal_matrix()).strassen(8);
+    CHECK(same_entries(Av, reference_product<int>(A, v.diagonal_matrix())));
+
+    // a result sharing its storage with an operand
+    matrix<int> S(64, 64), T(64, 64);
+    fill_pattern(S, 5);
+    fill_pattern(T, 6);
+    const matrix<int> expected = reference_product<int>(S, T);
+    force_multiplication((S*T).strassen(8), S);
+    CHECK(same_entries(S, expected));
+
+    // results whose rows are not contiguous get the product through a temporary
+    matrix<int> P(20, 20), Q(20, 20), R(20, 20);
+    fill_pattern(P, 9);
+    fill_pattern(Q, 10);
+    force_multiplication((P*Q).strassen(4), R.transpose());
+    CHECK(same_entries(R.transpose(), reference_product<int>(P, Q)));
+    matrix<int> wide(20, 30);
+    force_multiplication((P*Q).strassen(4), wide.window({0, 20, 5, 25}).transpose());
+    CHECK(same_entries(wide.window({0, 20, 5, 25}).transpose(), reference_product<int>(P, Q)));
+
+    // floating point, within the bound of the fast algorithm
+    matrix<double> D(130, 120), E(120, 110);
+    fill_pattern(D, 7);
+    fill_pattern(E, 8);
+    matrix<double> DE = (D*E).strassen(16);
+    CHECK(same_entries(DE, reference_product<double>(D, E), 1e-9));
+
+    return check_failures();
+}
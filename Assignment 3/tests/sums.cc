@@ -0,0 +1,67 @@
+#include"check.h"
+
+// a + b + c entry by entry
+template<typename T, class A, class B, class C>
+matrix<T> reference_sum(const A& a, const B& b, const C& c) {
+    matrix<T> result(a.get_height(), a.get_width());
+    for (unsigned i=0; i!=a.get_height(); ++i)
+        for (unsigned j=0; j!=a.get_width(); ++j) result(i,j) = a(i,j) + b(i,j) + c(i,j);
+    return result;
+}
+
+// sums of any number of terms, evaluated in one pass into their result
+int main() {
+    matrix<int> A(300, 300), B(300, 300), C(300, 300), D(300, 300);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(C, 3);
+    fill_pattern(D, 4);
+
+    // contiguous terms, in bands of rows computed concurrently
+    matrix<int> ABCD = A+B+C+D;
+    bool exact = true;
+    for (unsigned i=0; i!=300; ++i)
+        for (unsigned j=0; j!=300; ++j) exact &= ABCD(i,j)==A(i,j)+B(i,j)+C(i,j)+D(i,j);
+    CHECK(exact);
+
+    // transposed and windowed terms are walked along their own strides
+    matrix<int> strided = A.window({0, 100, 0, 100}).transpose()+B.window({100, 200, 50, 150})
+                          +C.transpose().window({7, 107, 3, 103});
+    CHECK(same_entries(strided, reference_sum<int>(A.window({0, 100, 0, 100}).transpose(),
+                                                   B.window({100, 200, 50, 150}),
+                                                   C.transpose().window({7, 107, 3, 103}))));
+
+    // a term without storage of its own is read entry by entry
+    matrix<int> v(300, 1);
+    fill_pattern(v, 5);
+    matrix<int> diag = A+v.diagonal_matrix()+B.transpose();
+    CHECK(same_entries(diag, reference_sum<int>(A, v.diagonal_matrix(), B.transpose())));
+
+    // rows longer than the chunk accumulated at a time
+    matrix<double> E(3, sum_chunk+100), F(3, sum_chunk+100), G(3, sum_chunk+100);
+    fill_pattern(E, 6);
+    fill_pattern(F, 7);
+    fill_pattern(G, 8);
+    matrix<double> EFG = E+F+G;
+    CHECK(same_entries(EFG, reference_sum<double>(E, F, G)));
+
+    // into a transposed result, and into a window of a larger one
+    matrix<int> R(300, 300), wide(120, 320);
+    force_addition(A+B+C, R.transpose());
+    CHECK(same_entries(R.transpose(), reference_sum<int>(A, B, C)));
+    force_addition(A.window({0, 100, 0, 300})+B.window({0, 100, 0, 300})+C.window({0, 100, 0, 300}),
+                   wide.window({10, 110, 10, 310}));
+    CHECK(same_entries(wide.window({10, 110, 10, 310}),
+                       reference_sum<int>(A.window({0, 100, 0, 300}), B.window({0, 100, 0, 300}),
+                                          C.window({0, 100, 0, 300}))));
+    CHECK(wide(9, 10)==0 && wide(10, 9)==0 && wide(110, 10)==0 && wide(10, 310)==0);
+
+    // no temporary is taken, whatever the number of terms
+    temporary_pool& pool = temporary_pool::instance();
+    const std::size_t total = pool.get_total();
+    matrix<int> many = A+B+C+D+A+B+C+D;
+    CHECK(pool.get_total()==total);
+    CHECK(many(17, 23)==2*ABCD(17, 23));
+
+    return check_failures();
+}
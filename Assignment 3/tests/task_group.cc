@@ -0,0 +1,67 @@
+#include<atomic>
+#include<chrono>
+#include<thread>
+#include<stdexcept>
+
+#include"check.h"
+
+// sum of [from, to) by nested groups, split until a piece is small
+long nested_sum(thread_pool& pool, long from, long to) {
+    if (to-from <= 64) {
+        long sum = 0;
+        for (long i=from; i!=to; ++i) sum += i;
+        return sum;
+    }
+    long left = 0, right = 0;
+    const long middle = from + (to-from)/2;
+    task_group tasks(pool);
+    tasks.run([&] { left = nested_sum(pool, from, middle); });
+    right = nested_sum(pool, middle, to);
+    tasks.wait();
+    return left + right;
+}
+
+// groups waited for on the pool, nested and from several threads at once
+int main() {
+    thread_pool pool(4, 2);
+    CHECK(nested_sum(pool, 0, 100000) == 100000L*99999/2);
+
+    std::atomic<long> total{0};
+    {
+        std::vector<std::thread> outside;
+        for (int t=0; t!=4; ++t)
+            outside.emplace_back([&] { total += nested_sum(pool, 0, 20000); });
+        for (auto& thread : outside) thread.join();
+    }
+    CHECK(total == 4*(20000L*19999/2));
+
+    // a task that finishes long after the waiter ran out of work
+    std::atomic<bool> finished{false};
+    {
+        task_group tasks(pool);
+        tasks.run([&] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            finished = true;
+        });
+        tasks.wait();
+        CHECK(finished);
+    }
+
+    // the first exception of a task is rethrown by wait
+    task_group failing(pool);
+    for (int i=0; i!=8; ++i)
+        failing.run([i] { if (i==3) throw std::runtime_error("task failed"); });
+    bool thrown = false;
+    try { failing.wait(); }
+    catch(const std::runtime_error&) { thrown = true; }
+    CHECK(thrown);
+
+    // products through the shared pool
+    matrix<double> A(300, 200), B(200, 250);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    matrix<double> AB = A*B;
+    CHECK(same_entries(AB, reference_product<double>(A, B)));
+
+    return check_failures();
+}
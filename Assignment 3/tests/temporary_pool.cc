@@ -0,0 +1,64 @@
+#include"check.h"
+
+// statistics of the pool of temporaries, on a pool of its own and on the
+// one evaluations draw from
+int main() {
+    CHECK(pool_size_class(1) == pool_min_block);
+    CHECK(pool_size_class(pool_min_block) == pool_min_block);
+    CHECK(pool_size_class(pool_min_block+1) == 5120);
+    CHECK(pool_size_class(10000) == 10240);
+    CHECK(pool_size_class(1<<20) == 1<<20);
+
+    temporary_pool pool(1<<20);
+    void* block = pool.allocate(10000);
+    CHECK(pool.get_live() == 10240 && pool.get_peak() == 10240 && pool.get_total() == 10240);
+    pool.deallocate(block, 10000);
+    CHECK(pool.get_live() == 0 && pool.get_idle() == 10240);
+
+    // a block of the same size class is handed out again
+    void* again = pool.allocate(9000);
+    CHECK(again == block);
+    CHECK(pool.get_reused() == 1 && pool.get_idle() == 0);
+    void* other = pool.allocate(10000);
+    CHECK(other != again && pool.get_peak() == 2*10240 && pool.get_total() == 3*10240);
+    pool.reset_peak();
+    pool.deallocate(again, 9000);
+    CHECK(pool.get_peak() == 2*10240 && pool.get_live() == 10240);
+
+    // nothing is kept past the budget
+    pool.set_budget(10240);
+    CHECK(pool.get_idle() == 10240);
+    pool.deallocate(other, 10000);
+    CHECK(pool.get_idle() == 10240 && pool.get_live() == 0);
+    pool.set_budget(0);
+    CHECK(pool.get_idle() == 0);
+
+    // the intermediates of a chain go back to the shared pool, and the
+    // next evaluation of the same shapes reuses them
+    temporary_pool& shared = temporary_pool::instance();
+    matrix<double> A(200, 200), B(200, 200), C(200, 200), D(200, 200);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(C, 3);
+    fill_pattern(D, 4);
+    const std::size_t live = shared.get_live();
+    matrix<double> first = A*B*C*D;
+    CHECK(shared.get_live() == live);
+    const std::size_t reused = shared.get_reused();
+    matrix<double> second = A*B*C*D;
+    CHECK(shared.get_reused() > reused);
+    CHECK(same_entries(first, second));
+
+    // an intermediate is released as soon as the next step consumed it: a
+    // chain of any length holds at most two of them at once
+    matrix<double> E(200, 200), F(200, 200);
+    fill_pattern(E, 5);
+    fill_pattern(F, 6);
+    const std::size_t intermediate = pool_size_class(200*200*sizeof(double) + pool_min_block);
+    shared.reset_peak();
+    matrix<double> longer = A*B*C*D*E*F;
+    CHECK(shared.get_peak() - live <= 2*intermediate);
+    CHECK(shared.get_live() == live);
+
+    return check_failures();
+}
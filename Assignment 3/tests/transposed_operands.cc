@@ -0,0 +1,40 @@
+#include"check.h"
+
+// products reading transposed and windowed operands straight from storage
+int main() {
+    matrix<double> A(70, 50), B(90, 50), C(50, 60);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(C, 3);
+
+    matrix<double> AB = A*B.transpose();
+    CHECK(same_entries(AB, reference_product<double>(A, B.transpose())));
+
+    matrix<double> AtA = A.transpose()*A;
+    CHECK(same_entries(AtA, reference_product<double>(A.transpose(), A)));
+
+    matrix<double> W = A.window({10, 40, 5, 45}).transpose()*B.window({0, 30, 0, 30});
+    CHECK(same_entries(W, reference_product<double>(A.window({10, 40, 5, 45}).transpose(),
+                                                     B.window({0, 30, 0, 30}))));
+
+    matrix<double> T = C.transpose().window({3, 50, 7, 40})*A.window({7, 40, 0, 20});
+    CHECK(same_entries(T, reference_product<double>(C.transpose().window({3, 50, 7, 40}),
+                                                    A.window({7, 40, 0, 20}))));
+
+    matrix<int,8,6> S;
+    matrix<int,5,6> R;
+    fill_pattern(S, 4);
+    fill_pattern(R, 5);
+    matrix<int,8,5> SR = S*R.transpose();
+    CHECK(same_entries(SR, reference_product<int>(S, R.transpose())));
+
+    // results that cannot be written row by row
+    matrix<double> AC(60, 70);
+    force_multiplication(A*C, AC.transpose());
+    CHECK(same_entries(AC.transpose(), reference_product<double>(A, C)));
+    matrix<double> D(70, 70);
+    force_multiplication(A*B.window({0, 1, 0, 50}).transpose(), D.window({0, 70, 3, 4}));
+    CHECK(same_entries(D.window({0, 70, 3, 4}), reference_product<double>(A, B.window({0, 1, 0, 50}).transpose())));
+
+    return check_failures();
+}
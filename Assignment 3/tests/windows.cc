@@ -0,0 +1,42 @@
+#include"check.h"
+
+// windows of unevaluated products and sums: only the block asked for is computed
+int main() {
+    matrix<double> A(60, 40), B(40, 50), C(50, 70);
+    fill_pattern(A, 1);
+    fill_pattern(B, 2);
+    fill_pattern(C, 3);
+    const matrix<double> ABC = reference_product<double>(reference_product<double>(A, B), C);
+
+    matrix<double> block = (A*B*C).window({10, 35, 20, 61});
+    CHECK(same_entries(block, ABC.window({10, 35, 20, 61})));
+
+    // single rows, columns and entries
+    matrix<double> row = (A*B*C).window({59, 60, 0, 70});
+    CHECK(same_entries(row, ABC.window({59, 60, 0, 70})));
+    matrix<double> col = (A*B*C).window({0, 60, 0, 1});
+    CHECK(same_entries(col, ABC.window({0, 60, 0, 1})));
+    matrix<double> entry = (A*B*C).window({30, 31, 40, 41});
+    CHECK(entry(0, 0) == ABC(30, 40));
+
+    // windows of windows, and of a two-factor product
+    matrix<double> nested = (A*B*C).window({5, 55, 5, 65}).window({10, 20, 30, 40});
+    CHECK(same_entries(nested, ABC.window({15, 25, 35, 45})));
+    matrix<double> pair = (A*B).window({3, 9, 4, 44});
+    CHECK(same_entries(pair, reference_product<double>(A, B).window({3, 9, 4, 44})));
+
+    // a sum with a product term, windowed term by term
+    matrix<double> P(45, 30), Q(30, 45), S(45, 45);
+    fill_pattern(P, 5);
+    fill_pattern(Q, 6);
+    fill_pattern(S, 7);
+    const matrix<double> PQ = reference_product<double>(P, Q);
+    matrix<double> sum = (P*Q + S + S).window({20, 40, 10, 30});
+    matrix<double> expected(20, 20);
+    for (unsigned i=0; i!=20; ++i)
+        for (unsigned j=0; j!=20; ++j)
+            expected(i, j) = PQ(20+i, 10+j) + 2*S(20+i, 10+j);
+    CHECK(same_entries(sum, expected));
+
+    return check_failures();
+}
@@ -0,0 +1,232 @@
+#ifndef MATRIXLIB_THREAD_POOL_H
+#define MATRIXLIB_THREAD_POOL_H
+
+#include<vector>
+#include<deque>
+#include<algorithm>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<functional>
+#include<atomic>
+#include<exception>
+#include<cstdlib>
+#include<memory>
+#include<random>
+
+// work-stealing scheduler shared by every evaluation level. Each worker owns
+// a deque: it pushes and pops its own tasks at the back, while idle threads
+// steal from the front of a random victim. Tasks submitted from outside the
+// pool go to a shared queue. Queues are bounded: a task that does not fit is
+// run by the thread submitting it, so a burst of work never turns into a
+// burst of threads.
+class thread_pool {
+public:
+    explicit thread_pool(unsigned threads, std::size_t capacity) : count(threads), capacity(capacity) {
+        for (unsigned i=0; i<=threads; ++i)
+            queues.emplace_back(new task_queue);
+        for (unsigned i=0; i!=threads; ++i)
+            workers.emplace_back([this, i] { work(i); });
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mtx);
+            stopping = true;
+        }
+        ready.notify_all();
+        for (auto& t: workers) t.join();
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    // number of workers: MATRIXLIB_THREADS if set, hardware_concurrency otherwise
+    static unsigned default_threads() {
+        if (const char* env = std::getenv("MATRIXLIB_THREADS"))
+            if (int n = std::atoi(env)) return unsigned(n);
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    static thread_pool& instance() {
+        static thread_pool pool(default_threads(), 64);
+        return pool;
+    }
+
+    unsigned size() const { return count; }
+
+    // false when the queue of the calling thread is full
+    bool try_push(std::function<void()>& task) {
+        task_queue& q = *queues[own_queue()];
+        {
+            std::lock_guard<std::mutex> lock(q.mtx);
+            if (q.tasks.size() >= capacity) return false;
+            q.tasks.push_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleep_mtx);
+            ++queued;
+        }
+        ready.notify_one();
+        waiting.notify_all();
+        return true;
+    }
+
+    // blocks the calling thread until a task is queued or finished() holds
+    template<class P>
+    void wait_for_work(P finished) {
+        std::unique_lock<std::mutex> lock(sleep_mtx);
+        waiting.wait(lock, [&] { return queued != 0 || finished(); });
+    }
+
+    // wakes the threads in wait_for_work once what they wait for may hold
+    void notify_finished() {
+        std::lock_guard<std::mutex> lock(sleep_mtx);
+        waiting.notify_all();
+    }
+
+    // runs one task in the calling thread: the newest of its own queue, else
+    // the oldest of the shared queue, else one stolen from a random worker
+    bool run_one() {
+        std::function<void()> task;
+        const unsigned own = own_queue();
+        if (!pop(own, true, task) && (own==count || !pop(count, false, task))) {
+            const unsigned start = random_index();
+            for (unsigned i=0; i!=count && !task; ++i) {
+                const unsigned victim = (start+i) % count;
+                if (victim != own) pop(victim, false, task);
+            }
+            if (!task) return false;
+        }
+        task();
+        return true;
+    }
+
+private:
+    struct task_queue {
+        std::mutex mtx;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool pop(unsigned index, bool back, std::function<void()>& task) {
+        task_queue& q = *queues[index];
+        {
+            std::lock_guard<std::mutex> lock(q.mtx);
+            if (q.tasks.empty()) return false;
+            if (back) {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            } else {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+        }
+        --queued;
+        return true;
+    }
+
+    // index of the queue of the calling thread, the shared one for non-workers
+    unsigned own_queue() const {
+        return current_pool()==this ? current_index() : count;
+    }
+
+    unsigned random_index() {
+        thread_local std::minstd_rand rng(std::hash<std::thread::id>()(std::this_thread::get_id()));
+        return rng() % count;
+    }
+
+    static const thread_pool*& current_pool() {
+        thread_local const thread_pool* pool = nullptr;
+        return pool;
+    }
+    static unsigned& current_index() {
+        thread_local unsigned index = 0;
+        return index;
+    }
+
+    void work(unsigned index) {
+        current_pool() = this;
+        current_index() = index;
+        for (;;) {
+            if (run_one()) continue;
+            std::unique_lock<std::mutex> lock(sleep_mtx);
+            ready.wait(lock, [this] { return stopping || queued != 0; });
+            if (stopping && queued == 0) return;
+        }
+    }
+
+    const unsigned count;
+    std::vector<std::unique_ptr<task_queue>> queues;
+    std::vector<std::thread> workers;
+    std::size_t capacity;
+    std::atomic<std::size_t> queued{0};
+    std::mutex sleep_mtx;
+    std::condition_variable ready, waiting;
+    bool stopping = false;
+};
+
+
+// set of tasks submitted to the pool and waited for together. A waiting
+// thread never blocks while there is work: it keeps running its own tasks or
+// stealing others, so groups nest at any depth (a sum inside a product inside
+// a sum) on a fixed number of threads. With nothing to run it sleeps until a
+// task is queued or the last of its own finishes.
+class task_group {
+public:
+    explicit task_group(thread_pool& pool = thread_pool::instance()) : pool(pool) {}
+
+    ~task_group() {
+        try { wait(); } catch(...) {}
+    }
+
+    template<class F>
+    void run(F&& f) {
+        ++pending;
+        std::function<void()> task = [this, f]() mutable {
+            try { f(); }
+            catch(...) {
+                std::lock_guard<std::mutex> lock(mtx);
+                if (!error) error = std::current_exception();
+            }
+            // the group may be gone as soon as pending reaches 0
+            thread_pool& tasks_pool = pool;
+            if (--pending == 0) tasks_pool.notify_finished();
+        };
+        if (!pool.try_push(task)) task();
+    }
+
+    // runs f concurrently with g, g in the calling thread
+    template<class F, class G>
+    static void fork_join(F&& f, G&& g) {
+        task_group tasks;
+        tasks.run(std::ref(f));
+        try { g(); }
+        catch(...) {
+            try { tasks.wait(); } catch(...) {}
+            throw;
+        }
+        tasks.wait();
+    }
+
+    // waits for every task and rethrows the first exception raised by one
+    void wait() {
+        while (pending != 0) {
+            if (pool.run_one()) continue;
+            pool.wait_for_work([this] { return pending == 0; });
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        if (error) {
+            std::exception_ptr e = error;
+            error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+
+private:
+    thread_pool& pool;
+    std::atomic<unsigned> pending{0};
+    std::exception_ptr error;
+    std::mutex mtx;
+};
+
+#endif //MATRIXLIB_THREAD_POOL_H